@@ -0,0 +1,451 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <thread>
+
+#include "H5IO.h"
+
+/**
+ * Throughput benchmark for H5IO.
+ *
+ * Times writeArrayToFile, appends, strided memory hyperslab writes and
+ * readArrayFromFile over a matrix of array sizes, ranks, types and
+ * compression settings, and prints one record per case as CSV (default) or
+ * JSON. Run with --help for options.
+ *
+ * With --concurrent N, times instead 1 to N threads each writing its own
+ * file with its own H5IO, to show how writes of separate files scale.
+ */
+
+struct Options
+{
+  size_t min_bytes, max_bytes;
+  int repeat, threads, concurrent;
+  bool json;
+  std::string file_name;
+};
+
+struct Record
+{
+  std::string test, type, compression;
+  int rank;
+  size_t bytes; //bytes moved per call
+  int calls,
+      failures; //calls that returned false
+  double seconds, //total time of all calls
+         min_call; //fastest call
+};
+
+struct TypeCase
+{
+  std::string name;
+  hid_t type;
+  size_t size;
+};
+
+struct CompressionCase
+{
+  std::string name;
+  int method, level;
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double _seconds(bench_clock::time_point start)
+{
+  return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+/**
+ * @brief Fill a buffer with a smooth field, so compression has work to do
+ */
+static void _fill(std::vector<char> &buffer, const TypeCase &type)
+{
+  size_t n = buffer.size() / type.size;
+  for(size_t i = 0; i < n; ++i)
+  {
+    double value = 1000.0 * std::sin(0.001 * i);
+    if(type.type == H5T_NATIVE_FLOAT)
+      ((float *) &buffer[0])[i] = (float) value;
+    else if(type.type == H5T_NATIVE_DOUBLE)
+      ((double *) &buffer[0])[i] = value;
+    else
+      ((int *) &buffer[0])[i] = (int) value;
+  }
+}
+
+/**
+ * @brief Set up an H5IO the way every case uses it
+ */
+static void _configure(H5IO &io, const CompressionCase &compression, const Options &options)
+{
+  io.setCompression(compression.method, compression.level);
+  if(options.threads > 1)
+  {
+    io.setThreads(options.threads);
+    io.setParallelCompression(true);
+  }
+}
+
+static std::string _dsetName(int i)
+{
+  std::ostringstream name;
+  name << "dataset" << i;
+  return name.str();
+}
+
+/**
+ * @brief Time whole-array writes, then reads of what was written
+ */
+static void _benchWriteRead(H5SizeArray &dims, const TypeCase &type, const CompressionCase &compression,
+  const Options &options, std::vector<Record> &records)
+{
+  int rank = dims.getRank();
+  size_t bytes = type.size;
+  for(int i = 0; i < rank; ++i)
+    bytes *= dims[i];
+  std::vector<char> data(bytes);
+  _fill(data, type);
+
+  Record write = {"write", type.name, compression.name, rank, bytes, options.repeat, 0, 0, 1e300};
+  Record read = write;
+  read.test = "read";
+
+  std::remove(options.file_name.c_str());
+  {
+    H5IO io(rank, dims, type.type);
+    _configure(io, compression, options);
+
+    bench_clock::time_point total = bench_clock::now();
+    for(int i = 0; i < options.repeat; ++i)
+    {
+      bench_clock::time_point call = bench_clock::now();
+      if(!io.writeArrayToFile(&data[0], options.file_name, _dsetName(i), false))
+        ++write.failures;
+      write.min_call = std::min(write.min_call, _seconds(call));
+    }
+    io.closeFile();
+    write.seconds = _seconds(total);
+
+    total = bench_clock::now();
+    for(int i = 0; i < options.repeat; ++i)
+    {
+      bench_clock::time_point call = bench_clock::now();
+      if(!io.readArrayFromFile(&data[0], options.file_name, _dsetName(i)))
+        ++read.failures;
+      read.min_call = std::min(read.min_call, _seconds(call));
+    }
+    io.closeFile();
+    read.seconds = _seconds(total);
+  }
+
+  records.push_back(write);
+  records.push_back(read);
+}
+
+/**
+ * @brief Time writes of every other element in the last memory dimension
+ */
+static void _benchStrided(H5SizeArray &dims, const TypeCase &type, const CompressionCase &compression,
+  const Options &options, std::vector<Record> &records)
+{
+  int rank = dims.getRank();
+  H5SizeArray mem_dims(0), start(0), stride(0);
+  mem_dims.setRank(rank);
+  mem_dims = dims;
+  mem_dims[rank-1] *= 2;
+  start.setRank(rank);
+  start.setValues(0);
+  stride.setRank(rank);
+  stride.setValues(1);
+  stride[rank-1] = 2;
+
+  size_t bytes = type.size;
+  for(int i = 0; i < rank; ++i)
+    bytes *= dims[i];
+  std::vector<char> data(2 * bytes);
+  _fill(data, type);
+
+  Record strided = {"strided_write", type.name, compression.name, rank, bytes, options.repeat, 0, 0, 1e300};
+
+  std::remove(options.file_name.c_str());
+  {
+    H5IO io(rank, mem_dims, type.type);
+    _configure(io, compression, options);
+    io.setMemHyperslab(start, stride);
+
+    bench_clock::time_point total = bench_clock::now();
+    for(int i = 0; i < options.repeat; ++i)
+    {
+      bench_clock::time_point call = bench_clock::now();
+      if(!io.writeArrayToFile(&data[0], options.file_name, _dsetName(i), false))
+        ++strided.failures;
+      strided.min_call = std::min(strided.min_call, _seconds(call));
+    }
+    io.closeFile();
+    strided.seconds = _seconds(total);
+  }
+
+  records.push_back(strided);
+}
+
+/**
+ * @brief Time appending an array one row (first dimension) at a time
+ * @details Each call appends one row; bytes is the size of a row.
+ */
+static void _benchAppend(H5SizeArray &dims, const TypeCase &type, const CompressionCase &compression,
+  const Options &options, std::vector<Record> &records)
+{
+  int rank = dims.getRank();
+  if(rank < 2)
+    return;
+
+  H5SizeArray row_dims(0);
+  row_dims.setRank(rank - 1);
+  size_t row_bytes = type.size;
+  for(int i = 1; i < rank; ++i)
+  {
+    row_dims[i-1] = dims[i];
+    row_bytes *= dims[i];
+  }
+  int rows = dims[0];
+  std::vector<char> data(row_bytes * rows);
+  _fill(data, type);
+
+  Record append = {"append", type.name, compression.name, rank, row_bytes, rows, 0, 0, 1e300};
+
+  std::remove(options.file_name.c_str());
+  {
+    H5IO io(rank - 1, row_dims, type.type);
+    _configure(io, compression, options);
+
+    bench_clock::time_point total = bench_clock::now();
+    for(int i = 0; i < rows; ++i)
+    {
+      bench_clock::time_point call = bench_clock::now();
+      if(!io.writeArrayToFile(&data[i * row_bytes], options.file_name, "table", true))
+        ++append.failures;
+      append.min_call = std::min(append.min_call, _seconds(call));
+    }
+    io.closeFile();
+    append.seconds = _seconds(total);
+  }
+
+  records.push_back(append);
+}
+
+/**
+ * @brief Time threads writers at once, each writing repeat arrays to its own
+ * file with its own H5IO
+ * @details calls and seconds are of all writers together, so MB/s is the
+ * total throughput.
+ */
+static void _benchConcurrent(int writers, H5SizeArray &dims, const TypeCase &type, const CompressionCase &compression,
+  const Options &options, std::vector<Record> &records)
+{
+  int rank = dims.getRank();
+  size_t bytes = type.size;
+  for(int i = 0; i < rank; ++i)
+    bytes *= dims[i];
+  std::vector<char> data(bytes);
+  _fill(data, type);
+
+  std::ostringstream test;
+  test << "concurrent_write_" << writers;
+  Record concurrent = {test.str(), type.name, compression.name, rank, bytes, writers * options.repeat, 0, 0, 1e300};
+
+  std::vector<std::string> file_names(writers);
+  std::vector<double> min_calls(writers, 1e300);
+  std::vector<int> failures(writers, 0);
+  for(int w = 0; w < writers; ++w)
+  {
+    std::ostringstream name;
+    name << options.file_name << "." << w;
+    file_names[w] = name.str();
+    std::remove(file_names[w].c_str());
+  }
+
+  bench_clock::time_point total = bench_clock::now();
+  std::vector<std::thread> threads;
+  for(int w = 0; w < writers; ++w)
+    threads.push_back(std::thread([&, w]() {
+      H5IO io(rank, dims, type.type);
+      _configure(io, compression, options);
+      for(int i = 0; i < options.repeat; ++i)
+      {
+        bench_clock::time_point call = bench_clock::now();
+        if(!io.writeArrayToFile(&data[0], file_names[w], _dsetName(i), false))
+          ++failures[w];
+        min_calls[w] = std::min(min_calls[w], _seconds(call));
+      }
+      io.closeFile();
+    }));
+  for(int w = 0; w < writers; ++w)
+    threads[w].join();
+  concurrent.seconds = _seconds(total);
+
+  for(int w = 0; w < writers; ++w)
+  {
+    concurrent.min_call = std::min(concurrent.min_call, min_calls[w]);
+    concurrent.failures += failures[w];
+    std::remove(file_names[w].c_str());
+  }
+  records.push_back(concurrent);
+}
+
+static void _printRecords(std::vector<Record> &records, const Options &options)
+{
+  if(options.json)
+    std::cout << "[" << std::endl;
+  else
+    std::cout << "test,rank,type,compression,bytes,calls,failures,seconds,mb_per_s,mean_latency_us,min_latency_us" << std::endl;
+
+  for(size_t i = 0; i < records.size(); ++i)
+  {
+    Record &r = records[i];
+    double mb_per_s = (double) r.bytes * r.calls / r.seconds / 1.0e6;
+    double mean_us = r.seconds / r.calls * 1.0e6;
+    double min_us = r.min_call * 1.0e6;
+
+    if(options.json)
+      std::cout << "  {\"test\": \"" << r.test << "\", \"rank\": " << r.rank
+        << ", \"type\": \"" << r.type << "\", \"compression\": \"" << r.compression
+        << "\", \"bytes\": " << r.bytes << ", \"calls\": " << r.calls << ", \"failures\": " << r.failures
+        << ", \"seconds\": " << r.seconds << ", \"mb_per_s\": " << mb_per_s
+        << ", \"mean_latency_us\": " << mean_us << ", \"min_latency_us\": " << min_us
+        << "}" << (i + 1 < records.size() ? "," : "") << std::endl;
+    else
+      std::cout << r.test << "," << r.rank << "," << r.type << "," << r.compression
+        << "," << r.bytes << "," << r.calls << "," << r.failures << "," << r.seconds << "," << mb_per_s
+        << "," << mean_us << "," << min_us << std::endl;
+  }
+
+  if(options.json)
+    std::cout << "]" << std::endl;
+}
+
+/**
+ * @brief Report cases with failed calls on stderr
+ *
+ * @return number of failed calls
+ */
+static int _checkFailures(std::vector<Record> &records)
+{
+  int failures = 0;
+  for(size_t i = 0; i < records.size(); ++i)
+    if(records[i].failures)
+    {
+      std::cerr << "Error: " << records[i].failures << " of " << records[i].calls << " calls failed in "
+        << records[i].test << " (rank " << records[i].rank << ", " << records[i].type << ", "
+        << records[i].compression << ")" << std::endl;
+      failures += records[i].failures;
+    }
+  return failures;
+}
+
+static void _usage()
+{
+  std::cerr << "Usage: benchmark [options]" << std::endl
+    << "  --min-bytes N   smallest array size (default 4096)" << std::endl
+    << "  --max-bytes N   largest array size (default 67108864; use 1073741824 for GB arrays)" << std::endl
+    << "  --repeat N      calls per case (default 5)" << std::endl
+    << "  --threads N     compress on N threads (default 1)" << std::endl
+    << "  --concurrent N  only time 1 to N threads writing separate files, with" << std::endl
+    << "                  arrays of --max-bytes / 16 bytes" << std::endl
+    << "  --json          print JSON instead of CSV" << std::endl
+    << "  --file NAME     scratch file (default benchmark.h5)" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  Options options = {4096, 64 << 20, 5, 1, 0, false, "benchmark.h5"};
+
+  for(int i = 1; i < argc; ++i)
+  {
+    std::string arg = argv[i];
+    bool has_value = (i + 1 < argc);
+    if(arg == "--json")
+      options.json = true;
+    else if(arg == "--min-bytes" && has_value)
+      options.min_bytes = std::strtoull(argv[++i], NULL, 10);
+    else if(arg == "--max-bytes" && has_value)
+      options.max_bytes = std::strtoull(argv[++i], NULL, 10);
+    else if(arg == "--repeat" && has_value)
+      options.repeat = std::atoi(argv[++i]);
+    else if(arg == "--threads" && has_value)
+      options.threads = std::atoi(argv[++i]);
+    else if(arg == "--concurrent" && has_value)
+      options.concurrent = std::atoi(argv[++i]);
+    else if(arg == "--file" && has_value)
+      options.file_name = argv[++i];
+    else
+    {
+      _usage();
+      return 1;
+    }
+  }
+  if(options.repeat < 1)
+    options.repeat = 1;
+  if(options.min_bytes == 0 || options.min_bytes > options.max_bytes)
+  {
+    std::cerr << "--min-bytes must be at least 1 and at most --max-bytes" << std::endl;
+    _usage();
+    return 1;
+  }
+
+  const TypeCase types[] = {
+    {"float", H5T_NATIVE_FLOAT, sizeof(float)},
+    {"double", H5T_NATIVE_DOUBLE, sizeof(double)},
+    {"int", H5T_NATIVE_INT, sizeof(int)}
+  };
+  const CompressionCase compressions[] = {
+    {"none", H5Compression::none, 0},
+    {"deflate1", H5Compression::deflate, 1},
+    {"shuffle_deflate1", H5Compression::shuffle_deflate, 1}
+  };
+  const int num_types = sizeof(types) / sizeof(types[0]),
+            num_compressions = sizeof(compressions) / sizeof(compressions[0]);
+
+  std::vector<Record> records;
+  if(options.concurrent > 0)
+  {
+    // float cubes, so every writer has the same work
+    hsize_t side = (hsize_t) (std::pow((double) (options.max_bytes / 16 / sizeof(float)), 1.0 / 3) + 1e-6);
+    H5SizeArray dims(0);
+    dims.setRank(3);
+    dims.setValues(std::max<hsize_t>(side, 2));
+    for(int c = 0; c < num_compressions; ++c)
+      for(int writers = 1; writers <= options.concurrent; ++writers)
+        _benchConcurrent(writers, dims, types[0], compressions[c], options, records);
+    _printRecords(records, options);
+    return _checkFailures(records) ? 1 : 0;
+  }
+
+  for(size_t bytes = options.min_bytes; bytes <= options.max_bytes; bytes *= 16)
+    for(int rank = 1; rank <= 3; ++rank)
+      for(int t = 0; t < num_types; ++t)
+        for(int c = 0; c < num_compressions; ++c)
+        {
+          // cube with about the wanted number of bytes
+          hsize_t side = (hsize_t) (std::pow((double) (bytes / types[t].size), 1.0 / rank) + 1e-6);
+          if(side < 2)
+            continue;
+          H5SizeArray dims(0);
+          dims.setRank(rank);
+          dims.setValues(side);
+
+          _benchWriteRead(dims, types[t], compressions[c], options, records);
+          _benchStrided(dims, types[t], compressions[c], options, records);
+          _benchAppend(dims, types[t], compressions[c], options, records);
+        }
+
+  std::remove(options.file_name.c_str());
+  _printRecords(records, options);
+  return _checkFailures(records) ? 1 : 0;
+}
@@ -0,0 +1,196 @@
+#include <hdf5.h>
+#include "H5Access.h"
+
+/**
+ * @brief HDF5's default access settings
+ */
+H5Access::H5Access()
+: chunk_cache_bytes(0), chunk_cache_slots(0), chunk_cache_w0(-1),
+  metadata_cache_bytes(0), align_threshold(1), align_bytes(1),
+  latest_format(false), collective_metadata(false), in_memory(false),
+  backing_store(true), memory_increment(1 << 20) { }
+
+/**
+ * @brief Access settings from a preset
+ *
+ * @param preset_in one of enum preset
+ */
+H5Access::H5Access(int preset_in)
+: H5Access()
+{
+  if(preset_in == throughput || preset_in == striped)
+  {
+    setChunkCache(64 << 20, 12421, 0.75);
+    setMetadataCache(16 << 20);
+    setAlignment(64 << 10, 1 << 20);
+    setLatestFormat(true);
+  }
+  if(preset_in == striped)
+  {
+    setAlignment(1 << 20, 4 << 20);
+    setCollectiveMetadata(true);
+  }
+}
+
+/**
+ * @brief Set the chunk cache of each open dataset
+ * @details A chunk read through the cache is decompressed once as long as
+ * it stays cached, so the cache should hold all chunks a typical read
+ * touches (eg. a row of chunks for a slice of a 3D dataset).
+ *
+ * @param bytes_in size of the cache in bytes (0 for default)
+ * @param slots_in hash table slots (0 for default); a prime about 100
+ * times the number of chunks that fit works well
+ * @param w0_in preemption policy between 0 and 1 (negative for default)
+ */
+void H5Access::setChunkCache(size_t bytes_in, size_t slots_in, double w0_in)
+{
+  chunk_cache_bytes = bytes_in;
+  chunk_cache_slots = slots_in;
+  chunk_cache_w0 = w0_in;
+}
+
+/**
+ * @brief Set the initial size of the metadata cache (0 for default)
+ * @details The cache still resizes itself; its limits are widened to
+ * include this size.
+ */
+void H5Access::setMetadataCache(size_t bytes_in)
+{
+  metadata_cache_bytes = bytes_in;
+}
+
+/**
+ * @brief Align file objects of at least threshold_in bytes to
+ * multiples of alignment_in (1 and 1 for no alignment)
+ * @details Matching the stripe size of a parallel file system keeps
+ * chunks from straddling stripes.
+ */
+void H5Access::setAlignment(hsize_t threshold_in, hsize_t alignment_in)
+{
+  align_threshold = threshold_in;
+  align_bytes = alignment_in;
+}
+
+/**
+ * @brief Write the latest file format
+ * @details Faster for many datasets and appends, but older HDF5 versions
+ * can't read it.
+ */
+void H5Access::setLatestFormat(bool latest_in)
+{
+  latest_format = latest_in;
+}
+
+/**
+ * @brief Do metadata reads and writes collectively
+ * @details Only used by HDF5 libraries built for MPI (H5_HAVE_PARALLEL).
+ */
+void H5Access::setCollectiveMetadata(bool collective_in)
+{
+  collective_metadata = collective_in;
+}
+
+/**
+ * @brief Build files in memory
+ * @details Files are opened with HDF5's core driver: the whole file is
+ * read into memory when opened, and all writes go to memory. With a
+ * backing store the file is written to disk in one go by a flush
+ * (H5IO::flushFile) or when it is closed; without one it never touches the
+ * disk and is lost when closed (see H5IO::getFileImage). Not available with
+ * MPI.
+ *
+ * @param in_memory_in keep files in memory
+ * @param backing_store_in write files to disk on flush and close
+ * @param increment_in bytes the memory of a file grows by
+ */
+void H5Access::setInMemory(bool in_memory_in, bool backing_store_in, size_t increment_in)
+{
+  in_memory = in_memory_in;
+  backing_store = backing_store_in;
+  memory_increment = increment_in;
+}
+
+bool H5Access::isInMemory() const
+{
+  return in_memory;
+}
+
+size_t H5Access::getChunkCacheBytes() const
+{
+  return chunk_cache_bytes;
+}
+
+bool H5Access::operator==(const H5Access &other) const
+{
+  return chunk_cache_bytes == other.chunk_cache_bytes && chunk_cache_slots == other.chunk_cache_slots
+    && chunk_cache_w0 == other.chunk_cache_w0 && metadata_cache_bytes == other.metadata_cache_bytes
+    && align_threshold == other.align_threshold && align_bytes == other.align_bytes
+    && latest_format == other.latest_format && collective_metadata == other.collective_metadata
+    && in_memory == other.in_memory && backing_store == other.backing_store
+    && memory_increment == other.memory_increment;
+}
+
+bool H5Access::operator!=(const H5Access &other) const
+{
+  return !(*this == other);
+}
+
+/**
+ * @brief Set these settings on a file access property list
+ */
+void H5Access::applyFileAccess(hid_t fapl_id) const
+{
+  if(in_memory)
+    H5Pset_fapl_core(fapl_id, memory_increment, backing_store);
+
+  if(chunk_cache_bytes || chunk_cache_slots || chunk_cache_w0 >= 0)
+  {
+    int mdc_elements;
+    size_t slots, bytes;
+    double w0;
+    H5Pget_cache(fapl_id, &mdc_elements, &slots, &bytes, &w0);
+    H5Pset_cache(fapl_id, mdc_elements, (chunk_cache_slots ? chunk_cache_slots : slots),
+      (chunk_cache_bytes ? chunk_cache_bytes : bytes), (chunk_cache_w0 >= 0 ? chunk_cache_w0 : w0));
+  }
+
+  if(metadata_cache_bytes)
+  {
+    H5AC_cache_config_t config;
+    config.version = H5AC__CURR_CACHE_CONFIG_VERSION;
+    H5Pget_mdc_config(fapl_id, &config);
+    config.set_initial_size = true;
+    config.initial_size = metadata_cache_bytes;
+    if(config.max_size < metadata_cache_bytes)
+      config.max_size = metadata_cache_bytes;
+    if(config.min_size > metadata_cache_bytes)
+      config.min_size = metadata_cache_bytes;
+    H5Pset_mdc_config(fapl_id, &config);
+  }
+
+  if(align_threshold != 1 || align_bytes != 1)
+    H5Pset_alignment(fapl_id, align_threshold, align_bytes);
+
+  if(latest_format)
+    H5Pset_libver_bounds(fapl_id, H5F_LIBVER_LATEST, H5F_LIBVER_LATEST);
+
+#ifdef H5_HAVE_PARALLEL
+  if(collective_metadata)
+  {
+    H5Pset_coll_metadata_write(fapl_id, true);
+    H5Pset_all_coll_metadata_ops(fapl_id, true);
+  }
+#endif
+}
+
+/**
+ * @brief Set these settings on a dataset access property list
+ */
+void H5Access::applyDatasetAccess(hid_t dapl_id) const
+{
+  if(chunk_cache_bytes || chunk_cache_slots || chunk_cache_w0 >= 0)
+    H5Pset_chunk_cache(dapl_id,
+      (chunk_cache_slots ? chunk_cache_slots : H5D_CHUNK_CACHE_NSLOTS_DEFAULT),
+      (chunk_cache_bytes ? chunk_cache_bytes : H5D_CHUNK_CACHE_NBYTES_DEFAULT),
+      (chunk_cache_w0 >= 0 ? chunk_cache_w0 : H5D_CHUNK_CACHE_W0_DEFAULT));
+}
@@ -0,0 +1,74 @@
+#ifndef H5Access_h
+#define H5Access_h
+
+#include <hdf5.h>
+#include <cstddef>
+
+/**
+ * @brief File and dataset access settings (caches, alignment, file format)
+ * @details Holds the tuning knobs HDF5 takes through file and dataset
+ * access property lists and knows how to set them on such lists. Settings
+ * left at 0 (or off) keep HDF5's defaults. Presets:
+ * - defaults: HDF5's defaults (1 MiB chunk cache per dataset, 521 slots)
+ * - throughput: 64 MiB chunk caches with many slots, a 16 MiB metadata
+ *   cache, large objects aligned to 1 MiB and the latest file format
+ * - striped: like throughput, but aligned to 4 MiB stripes and with
+ *   collective metadata I/O for MPI writes to parallel file systems
+ *
+ * The latest file format cannot be read by HDF5 versions older than the
+ * one writing it.
+ *
+ * Files can also be kept in memory (HDF5's core driver), see setInMemory.
+ */
+class H5Access
+{
+private:
+  size_t chunk_cache_bytes, //per open dataset
+         chunk_cache_slots; //hash table slots; a prime ~100x the chunks that fit
+  double chunk_cache_w0; //preemption of fully read/written chunks, 0-1; negative for default
+
+  size_t metadata_cache_bytes;
+
+  hsize_t align_threshold, //objects at least this large are aligned
+          align_bytes;
+
+  bool latest_format,
+       collective_metadata,
+       in_memory, //use the core driver
+       backing_store; //write in-memory files to disk on flush and close
+
+  size_t memory_increment; //bytes in-memory files grow by
+
+public:
+  enum preset {defaults, throughput, striped};
+
+  H5Access();
+
+  H5Access(int preset_in);
+
+  void setChunkCache(size_t bytes_in, size_t slots_in, double w0_in);
+
+  void setMetadataCache(size_t bytes_in);
+
+  void setAlignment(hsize_t threshold_in, hsize_t alignment_in);
+
+  void setLatestFormat(bool latest_in);
+
+  void setCollectiveMetadata(bool collective_in);
+
+  void setInMemory(bool in_memory_in, bool backing_store_in, size_t increment_in);
+
+  bool isInMemory() const;
+
+  size_t getChunkCacheBytes() const;
+
+  bool operator==(const H5Access &other) const;
+
+  bool operator!=(const H5Access &other) const;
+
+  void applyFileAccess(hid_t fapl_id) const;
+
+  void applyDatasetAccess(hid_t dapl_id) const;
+};
+
+#endif
@@ -0,0 +1,516 @@
+#include <hdf5.h>
+#include <stdint.h>
+#include <zlib.h>
+#include <cstring>
+#include <vector>
+#include <atomic>
+#include "H5ThreadPool.h"
+#include "H5IOStats.h"
+#include "H5ChunkStats.h"
+#include "H5ChunkIO.h"
+
+H5ChunkIO::H5ChunkIO()
+: rank(0), type_size(0), chunk_bytes(0), num_chunks(0), shuffle(false),
+  deflate_level(0), shuffle_mask(0), deflate_mask(0) { }
+
+/**
+ * @brief Read the chunk layout of a dataset
+ * @details Enough for extracting, inserting and hashing chunks, but not for
+ * encoding or decoding them; see setup().
+ *
+ * @param dset_id chunked dataset
+ * @return true if the dataset is chunked and has a fixed-size type
+ */
+bool H5ChunkIO::setupLayout(hid_t dset_id)
+{
+  hid_t dcpl = H5Dget_create_plist(dset_id);
+  hid_t type = H5Dget_type(dset_id);
+  hid_t space = H5Dget_space(dset_id);
+  bool supported = true;
+
+  type_size = H5Tget_size(type);
+  if(H5Tdetect_class(type, H5T_VLEN) > 0 || H5Tis_variable_str(type) > 0)
+    supported = false;
+
+  if(H5Pget_layout(dcpl) != H5D_CHUNKED)
+    supported = false;
+
+  if(supported)
+  {
+    rank = H5Sget_simple_extent_ndims(space);
+    dims.resize(rank);
+    chunk.resize(rank);
+    chunks_per_dim.resize(rank);
+    H5Sget_simple_extent_dims(space, &dims[0], NULL);
+    H5Pget_chunk(dcpl, rank, &chunk[0]);
+
+    chunk_bytes = type_size;
+    num_chunks = 1;
+    for(int i = 0; i < rank; ++i)
+    {
+      chunk_bytes *= chunk[i];
+      chunks_per_dim[i] = dims[i] / chunk[i] + !!(dims[i] % chunk[i]);
+      num_chunks *= chunks_per_dim[i];
+    }
+  }
+
+  H5Sclose(space);
+  H5Tclose(type);
+  H5Pclose(dcpl);
+  return supported;
+}
+
+/**
+ * @brief Read layout and filters of a dataset
+ *
+ * @param dset_id dataset to read or write
+ * @return true if chunks of the dataset can be handled directly
+ */
+bool H5ChunkIO::setup(hid_t dset_id)
+{
+  if(!setupLayout(dset_id))
+    return false;
+
+  hid_t dcpl = H5Dget_create_plist(dset_id);
+  bool supported = true;
+
+  H5D_fill_value_t fill_status;
+  H5Pfill_value_defined(dcpl, &fill_status);
+  if(fill_status == H5D_FILL_VALUE_USER_DEFINED)
+    supported = false;
+
+  // pipeline must be [deflate] or [shuffle, deflate]
+  int nfilters = H5Pget_nfilters(dcpl);
+  shuffle = false;
+  supported = supported && (nfilters == 1 || nfilters == 2);
+  for(int i = 0; supported && i < nfilters; ++i)
+  {
+    unsigned int flags, config, cd_values[8];
+    size_t cd_nelmts = 8;
+    H5Z_filter_t filter = H5Pget_filter2(dcpl, i, &flags, &cd_nelmts, cd_values, 0, NULL, &config);
+    if(filter == H5Z_FILTER_SHUFFLE && i == 0 && nfilters == 2)
+    {
+      shuffle = true;
+      shuffle_mask = 1u << i;
+    }
+    else if(filter == H5Z_FILTER_DEFLATE && i == nfilters - 1 && cd_nelmts > 0)
+    {
+      deflate_level = cd_values[0];
+      deflate_mask = 1u << i;
+    }
+    else
+      supported = false;
+  }
+
+  H5Pclose(dcpl);
+  return supported;
+}
+
+hsize_t H5ChunkIO::getNumChunks()
+{
+  return num_chunks;
+}
+
+size_t H5ChunkIO::getChunkBytes()
+{
+  return chunk_bytes;
+}
+
+/**
+ * @brief Get coordinates of the first element of a chunk
+ * @details Chunks are numbered in row-major order.
+ */
+void H5ChunkIO::getChunkOffset(hsize_t chunk_idx, hsize_t *offset)
+{
+  for(int i = rank - 1; i >= 0; --i)
+  {
+    offset[i] = (chunk_idx % chunks_per_dim[i]) * chunk[i];
+    chunk_idx /= chunks_per_dim[i];
+  }
+}
+
+/**
+ * @brief Get the part of the dataset covered by a chunk
+ * @details Edge chunks are clipped to the dataset.
+ */
+void H5ChunkIO::getChunkRegion(hsize_t chunk_idx, hsize_t *offset, hsize_t *extent)
+{
+  getChunkOffset(chunk_idx, offset);
+  for(int i = 0; i < rank; ++i)
+    extent[i] = (offset[i] + chunk[i] > dims[i] ? dims[i] - offset[i] : chunk[i]);
+}
+
+size_t H5ChunkIO::getTypeSize()
+{
+  return type_size;
+}
+
+/**
+ * @brief Copy one chunk between the contiguous array and a chunk buffer
+ * @details Parts of edge chunks outside the dataset are zero (the default
+ * fill value) in the chunk buffer.
+ */
+void H5ChunkIO::_copyChunk(hsize_t chunk_idx, char *array, char *chunk_data, bool to_chunk)
+{
+  std::vector<hsize_t> offset(rank), extent(rank), pos(rank, 0);
+  getChunkOffset(chunk_idx, &offset[0]);
+
+  bool partial = false;
+  hsize_t rows = 1;
+  for(int i = 0; i < rank; ++i)
+  {
+    extent[i] = (offset[i] + chunk[i] > dims[i] ? dims[i] - offset[i] : chunk[i]);
+    partial = partial || (extent[i] != chunk[i]);
+    if(i < rank - 1)
+      rows *= extent[i];
+  }
+  if(to_chunk && partial)
+    std::memset(chunk_data, 0, chunk_bytes);
+
+  size_t row_bytes = extent[rank-1] * type_size;
+  for(hsize_t r = 0; r < rows; ++r)
+  {
+    hsize_t array_idx = 0, chunk_elem = 0;
+    for(int i = 0; i < rank; ++i)
+    {
+      array_idx = array_idx * dims[i] + offset[i] + pos[i];
+      chunk_elem = chunk_elem * chunk[i] + pos[i];
+    }
+
+    if(to_chunk)
+      std::memcpy(chunk_data + chunk_elem * type_size, array + array_idx * type_size, row_bytes);
+    else
+      std::memcpy(array + array_idx * type_size, chunk_data + chunk_elem * type_size, row_bytes);
+
+    // advance position over all but the last dimension
+    for(int i = rank - 2; i >= 0; --i)
+    {
+      if(++pos[i] < extent[i])
+        break;
+      pos[i] = 0;
+    }
+  }
+}
+
+void H5ChunkIO::extractChunk(const char *array, hsize_t chunk_idx, char *chunk_data)
+{
+  _copyChunk(chunk_idx, const_cast<char *>(array), chunk_data, true);
+}
+
+void H5ChunkIO::insertChunk(const char *chunk_data, hsize_t chunk_idx, char *array)
+{
+  _copyChunk(chunk_idx, array, const_cast<char *>(chunk_data), false);
+}
+
+/**
+ * @brief Call visit on each row (along the last dimension) of a chunk's data
+ * @details Edge chunks are clipped to the dataset, so only data inside
+ * the dataset is visited.
+ *
+ * @param data contiguous array for the whole dataset, or a chunk buffer
+ * from extractChunk if in_chunk
+ * @param elem_size bytes per element of data, which need not be the
+ * dataset's type
+ * @param visit called with the first element and the length of each row
+ */
+void H5ChunkIO::visitChunkRows(hsize_t chunk_idx, const char *data, size_t elem_size, bool in_chunk,
+  const std::function<void(const char *, hsize_t)> &visit)
+{
+  std::vector<hsize_t> offset(rank), extent(rank), pos(rank, 0);
+  getChunkRegion(chunk_idx, &offset[0], &extent[0]);
+
+  hsize_t rows = 1;
+  for(int i = 0; i < rank - 1; ++i)
+    rows *= extent[i];
+
+  for(hsize_t r = 0; r < rows; ++r)
+  {
+    hsize_t idx = 0;
+    for(int i = 0; i < rank; ++i)
+      idx = (in_chunk ? idx * chunk[i] + pos[i] : idx * dims[i] + offset[i] + pos[i]);
+    visit(data + idx * elem_size, extent[rank-1]);
+
+    for(int i = rank - 2; i >= 0; --i)
+    {
+      if(++pos[i] < extent[i])
+        break;
+      pos[i] = 0;
+    }
+  }
+}
+
+/**
+ * @brief Compress a chunk the way HDF5's filter pipeline would
+ *
+ * @param chunk_data chunk_bytes bytes of chunk data
+ * @param scratch buffer for the shuffled chunk
+ * @param out compressed chunk
+ *
+ * @return filter mask to pass to H5Dwrite_chunk
+ */
+uint32_t H5ChunkIO::encode(const char *chunk_data, std::vector<char> &scratch, std::vector<char> &out)
+{
+  uint32_t filter_mask = 0;
+  const char *src = chunk_data;
+
+  if(shuffle && type_size > 1)
+  {
+    size_t n = chunk_bytes / type_size;
+    scratch.resize(chunk_bytes);
+    for(size_t j = 0; j < type_size; ++j)
+      for(size_t i = 0; i < n; ++i)
+        scratch[j * n + i] = chunk_data[i * type_size + j];
+    src = &scratch[0];
+  }
+
+  uLongf out_bytes = compressBound(chunk_bytes);
+  out.resize(out_bytes);
+  if(compress2((Bytef *) &out[0], &out_bytes, (const Bytef *) src, chunk_bytes, deflate_level) == Z_OK)
+  {
+    out.resize(out_bytes);
+  }
+  else
+  {
+    // deflate is an optional filter; store the chunk without it
+    out.assign(src, src + chunk_bytes);
+    filter_mask |= deflate_mask;
+  }
+  return filter_mask;
+}
+
+/**
+ * @brief Undo the filter pipeline on a raw chunk
+ *
+ * @param raw chunk as stored in the file
+ * @param filter_mask filter mask returned by H5Dread_chunk
+ * @param scratch buffer for the shuffled chunk
+ * @param chunk_data chunk_bytes bytes of output
+ *
+ * @return true on success
+ */
+bool H5ChunkIO::decode(std::vector<char> &raw, uint32_t filter_mask, std::vector<char> &scratch, char *chunk_data)
+{
+  bool unshuffle = shuffle && type_size > 1 && !(filter_mask & shuffle_mask);
+  char *dst = chunk_data;
+  if(unshuffle)
+  {
+    scratch.resize(chunk_bytes);
+    dst = &scratch[0];
+  }
+
+  if(filter_mask & deflate_mask)
+  {
+    if(raw.size() != chunk_bytes)
+      return false;
+    std::memcpy(dst, &raw[0], chunk_bytes);
+  }
+  else
+  {
+    uLongf out_bytes = chunk_bytes;
+    if(uncompress((Bytef *) dst, &out_bytes, (const Bytef *) &raw[0], raw.size()) != Z_OK
+        || out_bytes != chunk_bytes)
+      return false;
+  }
+
+  if(unshuffle)
+  {
+    size_t n = chunk_bytes / type_size;
+    for(size_t j = 0; j < type_size; ++j)
+      for(size_t i = 0; i < n; ++i)
+        chunk_data[i * type_size + j] = scratch[j * n + i];
+  }
+  return true;
+}
+
+/**
+ * @brief Write a whole dataset chunk by chunk
+ * @details Chunks are compressed in batches on the pool and then written
+ * one after the other from the calling thread.
+ *
+ * @param dset_id dataset set up with setup()
+ * @param array contiguous data for the whole dataset, in the dataset's type
+ * @param pool threads to compress with
+ * @param stats where compression and write times are recorded
+ * @param chunk_stats if given, per-chunk statistics are added from each
+ * chunk while it is in cache for compression
+ */
+bool H5ChunkIO::writeChunks(hid_t dset_id, const void *array, H5ThreadPool &pool, H5IOStats &stats,
+  H5ChunkStats *chunk_stats)
+{
+  size_t batch = pool.getThreads() * 4;
+  std::vector< std::vector<char> > chunk_buf(batch), scratch(batch), out(batch);
+  std::vector<uint32_t> masks(batch);
+  std::vector<hsize_t> offset(rank);
+  const char *data = (const char *) array;
+
+  for(hsize_t first = 0; first < num_chunks; first += batch)
+  {
+    size_t n = (num_chunks - first < batch ? num_chunks - first : batch);
+
+    {
+      H5IOStats::Timer timer(stats, H5IOStats::compression);
+      pool.parallelFor(n, [&](size_t i) {
+        chunk_buf[i].resize(chunk_bytes);
+        extractChunk(data, first + i, &chunk_buf[i][0]);
+        if(chunk_stats)
+          chunk_stats->addChunk(*this, first + i, &chunk_buf[i][0], true);
+        masks[i] = encode(&chunk_buf[i][0], scratch[i], out[i]);
+      });
+    }
+
+    H5IOStats::Timer timer(stats, H5IOStats::write);
+    for(size_t i = 0; i < n; ++i)
+    {
+      getChunkOffset(first + i, &offset[0]);
+      if(H5Dwrite_chunk(dset_id, H5P_DEFAULT, masks[i], &offset[0], out[i].size(), &out[i][0]) < 0)
+        return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Read the stored (filtered) bytes of one chunk
+ * @details raw is left empty for chunks that were never written.
+ */
+bool H5ChunkIO::readRawChunk(hid_t dset_id, hsize_t chunk_idx, std::vector<char> &raw, uint32_t &filter_mask)
+{
+  hsize_t offset[H5S_MAX_RANK];
+  hsize_t storage_size = 0;
+  getChunkOffset(chunk_idx, offset);
+
+#if H5_VERSION_GE(1,10,5)
+  // gives size 0 for unallocated chunks instead of failing
+  haddr_t address;
+  if(H5Dget_chunk_info_by_coord(dset_id, offset, &filter_mask, &address, &storage_size) < 0)
+    return false;
+#else
+  // unallocated chunks are expected; don't print the error stack
+  H5E_auto2_t error_func;
+  void *error_out;
+  H5Eget_auto(H5E_DEFAULT, &error_func, &error_out);
+  H5Eset_auto(H5E_DEFAULT, NULL, NULL);
+  if(H5Dget_chunk_storage_size(dset_id, offset, &storage_size) < 0)
+    storage_size = 0;
+  H5Eset_auto(H5E_DEFAULT, error_func, error_out);
+#endif
+
+  raw.resize(storage_size);
+  return storage_size == 0 || H5Dread_chunk(dset_id, H5P_DEFAULT, offset, &filter_mask, &raw[0]) >= 0;
+}
+
+/**
+ * @brief Read a whole dataset chunk by chunk
+ * @details Raw chunks are read in batches from the calling thread and then
+ * decompressed on the pool. Chunks never written are filled with zeros.
+ *
+ * @param dset_id dataset set up with setup()
+ * @param array contiguous buffer for the whole dataset, in the dataset's type
+ * @param pool threads to decompress with
+ * @param stats where read and decompression times are recorded
+ * @param chunk_list if given, only these chunks are read; the rest of
+ * array is left as it is
+ */
+bool H5ChunkIO::readChunks(hid_t dset_id, void *array, H5ThreadPool &pool, H5IOStats &stats,
+  const std::vector<hsize_t> *chunk_list)
+{
+  size_t batch = pool.getThreads() * 4;
+  std::vector< std::vector<char> > raw(batch), scratch(batch), chunk_buf(batch);
+  std::vector<uint32_t> masks(batch);
+  std::vector<hsize_t> chunk_idx(batch);
+  std::atomic<bool> success(true);
+  char *data = (char *) array;
+  hsize_t total = (chunk_list ? chunk_list->size() : num_chunks);
+
+  for(hsize_t first = 0; first < total; first += batch)
+  {
+    size_t n = (total - first < batch ? total - first : batch);
+
+    {
+      H5IOStats::Timer timer(stats, H5IOStats::read);
+      for(size_t i = 0; i < n; ++i)
+      {
+        chunk_idx[i] = (chunk_list ? (*chunk_list)[first + i] : first + i);
+        if(!readRawChunk(dset_id, chunk_idx[i], raw[i], masks[i]))
+          return false;
+      }
+    }
+
+    {
+      H5IOStats::Timer timer(stats, H5IOStats::compression);
+      pool.parallelFor(n, [&](size_t i) {
+        chunk_buf[i].resize(chunk_bytes);
+        if(raw[i].empty())
+          std::memset(&chunk_buf[i][0], 0, chunk_bytes);
+        else if(!decode(raw[i], masks[i], scratch[i], &chunk_buf[i][0]))
+          success = false;
+        insertChunk(&chunk_buf[i][0], chunk_idx[i], data);
+      });
+    }
+
+    if(!success)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Hash the data of one chunk, read in place from the array
+ * @details A 64-bit FNV-1a variant that mixes in 8 bytes at a time.
+ */
+uint64_t H5ChunkIO::_hashChunk(const char *array, hsize_t chunk_idx)
+{
+  std::vector<hsize_t> offset(rank), extent(rank), pos(rank, 0);
+  getChunkRegion(chunk_idx, &offset[0], &extent[0]);
+
+  hsize_t rows = 1;
+  for(int i = 0; i < rank - 1; ++i)
+    rows *= extent[i];
+
+  uint64_t hash = 14695981039346656037ULL;
+  size_t row_bytes = extent[rank-1] * type_size;
+  for(hsize_t r = 0; r < rows; ++r)
+  {
+    hsize_t array_idx = 0;
+    for(int i = 0; i < rank; ++i)
+      array_idx = array_idx * dims[i] + offset[i] + pos[i];
+    const char *bytes = array + array_idx * type_size;
+
+    size_t n = 0;
+    for(; n + 8 <= row_bytes; n += 8)
+    {
+      uint64_t word;
+      std::memcpy(&word, bytes + n, 8);
+      hash = (hash ^ word) * 1099511628211ULL;
+      hash ^= hash >> 29;
+    }
+    for(; n < row_bytes; ++n)
+      hash = (hash ^ (unsigned char) bytes[n]) * 1099511628211ULL;
+
+    for(int i = rank - 2; i >= 0; --i)
+    {
+      if(++pos[i] < extent[i])
+        break;
+      pos[i] = 0;
+    }
+  }
+  return hash;
+}
+
+/**
+ * @brief Hash the data of every chunk
+ * @details Used to find chunks that changed between writes; equal data
+ * gives equal hashes.
+ *
+ * @param array contiguous data for the whole dataset, in the dataset's type
+ * @param hashes one hash per chunk, in chunk order
+ * @param pool threads to hash with
+ */
+void H5ChunkIO::hashChunks(const void *array, std::vector<uint64_t> &hashes, H5ThreadPool &pool)
+{
+  hashes.resize(num_chunks);
+  const char *data = (const char *) array;
+  pool.parallelFor(num_chunks, [&](size_t i) {
+    hashes[i] = _hashChunk(data, i);
+  });
+}
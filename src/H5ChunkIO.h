@@ -0,0 +1,86 @@
+#ifndef H5ChunkIO_h
+#define H5ChunkIO_h
+
+#include <hdf5.h>
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include "H5ThreadPool.h"
+#include "H5IOStats.h"
+
+class H5ChunkStats;
+
+/**
+ * @brief Reads and writes whole chunks of a dataset directly
+ * @details Moves data between a contiguous array holding the whole dataset
+ * and the dataset's chunks with H5Dwrite_chunk/H5Dread_chunk, doing the
+ * (de)compression itself on a thread pool instead of in HDF5's serial
+ * filter pipeline. The chunks produced are identical to those written by
+ * the pipeline. Only the deflate and shuffle+deflate pipelines are
+ * supported; setup() fails for anything else.
+ */
+class H5ChunkIO
+{
+private:
+  int rank;
+
+  size_t type_size,
+         chunk_bytes;
+
+  std::vector<hsize_t> dims,
+                       chunk,
+                       chunks_per_dim;
+
+  hsize_t num_chunks;
+
+  bool shuffle;
+
+  int deflate_level;
+
+  uint32_t shuffle_mask, //filter mask bit of each filter
+           deflate_mask;
+
+  void _copyChunk(hsize_t chunk_idx, char *array, char *chunk_data, bool to_chunk);
+
+  uint64_t _hashChunk(const char *array, hsize_t chunk_idx);
+
+public:
+  H5ChunkIO();
+
+  bool setupLayout(hid_t dset_id);
+
+  bool setup(hid_t dset_id);
+
+  hsize_t getNumChunks();
+
+  size_t getChunkBytes();
+
+  void getChunkOffset(hsize_t chunk_idx, hsize_t *offset);
+
+  void getChunkRegion(hsize_t chunk_idx, hsize_t *offset, hsize_t *extent);
+
+  size_t getTypeSize();
+
+  void extractChunk(const char *array, hsize_t chunk_idx, char *chunk_data);
+
+  void insertChunk(const char *chunk_data, hsize_t chunk_idx, char *array);
+
+  void visitChunkRows(hsize_t chunk_idx, const char *data, size_t elem_size, bool in_chunk,
+    const std::function<void(const char *, hsize_t)> &visit);
+
+  uint32_t encode(const char *chunk_data, std::vector<char> &scratch, std::vector<char> &out);
+
+  bool decode(std::vector<char> &raw, uint32_t filter_mask, std::vector<char> &scratch, char *chunk_data);
+
+  bool readRawChunk(hid_t dset_id, hsize_t chunk_idx, std::vector<char> &raw, uint32_t &filter_mask);
+
+  bool writeChunks(hid_t dset_id, const void *array, H5ThreadPool &pool, H5IOStats &stats,
+    H5ChunkStats *chunk_stats = NULL);
+
+  bool readChunks(hid_t dset_id, void *array, H5ThreadPool &pool, H5IOStats &stats,
+    const std::vector<hsize_t> *chunk_list = NULL);
+
+  void hashChunks(const void *array, std::vector<uint64_t> &hashes, H5ThreadPool &pool);
+};
+
+#endif
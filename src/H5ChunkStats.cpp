@@ -0,0 +1,252 @@
+#include <hdf5.h>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstring>
+#include <stdint.h>
+#include "H5ThreadPool.h"
+#include "H5ChunkIO.h"
+#include "H5ChunkStats.h"
+
+namespace
+{
+
+enum kind {other, single, twice, int32, int64};
+
+const uint64_t exponent_bits = 0x7ff0000000000000ULL,
+               mantissa_bits = 0x000fffffffffffffULL;
+
+/*
+ * NaNs and infinities are told apart on the bits: with -ffast-math,
+ * value != value and std::isnan may be compiled to false.
+ */
+uint64_t _getBits(double value)
+{
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+bool _isNaN(double value)
+{
+  uint64_t bits = _getBits(value);
+  return (bits & exponent_bits) == exponent_bits && (bits & mantissa_bits) != 0;
+}
+
+bool _isFinite(double value)
+{
+  return (_getBits(value) & exponent_bits) != exponent_bits;
+}
+
+int _getKind(hid_t type)
+{
+  if(H5Tequal(type, H5T_NATIVE_FLOAT) > 0)
+    return single;
+  if(H5Tequal(type, H5T_NATIVE_DOUBLE) > 0)
+    return twice;
+  if(H5Tequal(type, H5T_NATIVE_INT32) > 0)
+    return int32;
+  if(H5Tequal(type, H5T_NATIVE_INT64) > 0)
+    return int64;
+  return other;
+}
+
+/**
+ * @brief Write a double attribute, replacing one that exists
+ */
+bool _writeAttribute(hid_t object_id, const char *name, double value)
+{
+  if(H5Aexists(object_id, name) > 0)
+    H5Adelete(object_id, name);
+  hid_t space = H5Screate(H5S_SCALAR),
+        attribute = H5Acreate(object_id, name, H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, H5P_DEFAULT);
+  bool written = attribute >= 0 && H5Awrite(attribute, H5T_NATIVE_DOUBLE, &value) >= 0;
+  if(attribute >= 0)
+    H5Aclose(attribute);
+  H5Sclose(space);
+  return written;
+}
+
+bool _readAttribute(hid_t object_id, const char *name, double &value)
+{
+  if(H5Aexists(object_id, name) <= 0)
+    return false;
+  hid_t attribute = H5Aopen(object_id, name, H5P_DEFAULT);
+  bool read = H5Aread(attribute, H5T_NATIVE_DOUBLE, &value) >= 0;
+  H5Aclose(attribute);
+  return read;
+}
+
+} // namespace
+
+H5ChunkStats::H5ChunkStats()
+: kind(other), bins(0), elem_size(0), hist_min(0), hist_max(0), num_chunks(0) { }
+
+/**
+ * @brief Start empty records for the chunks of data of a type
+ *
+ * @param type native type of the data
+ * @param num_chunks_in chunks of the dataset
+ * @param bins_in histogram bins; 0 for none
+ * @param hist_min_in lower edge of the first bin
+ * @param hist_max_in upper edge of the last bin
+ *
+ * @return false if the type is not supported
+ */
+bool H5ChunkStats::setup(hid_t type, hsize_t num_chunks_in, int bins_in, double hist_min_in, double hist_max_in)
+{
+  kind = _getKind(type);
+  elem_size = H5Tget_size(type);
+  bins = (bins_in > 0 && hist_max_in > hist_min_in ? bins_in : 0);
+  hist_min = hist_min_in;
+  hist_max = hist_max_in;
+  num_chunks = num_chunks_in;
+
+  records.assign(num_chunks * getColumns(), 0);
+  for(hsize_t i = 0; i < num_chunks; ++i)
+  {
+    records[i * getColumns() + min_column] = std::numeric_limits<double>::infinity();
+    records[i * getColumns() + max_column] = -std::numeric_limits<double>::infinity();
+  }
+  return kind != other;
+}
+
+int H5ChunkStats::getColumns() const
+{
+  return histogram_column + bins;
+}
+
+hsize_t H5ChunkStats::getNumChunks() const
+{
+  return num_chunks;
+}
+
+/**
+ * @brief Get the getColumns() values of a chunk's record
+ */
+const double * H5ChunkStats::getRecord(hsize_t chunk_idx) const
+{
+  return &records[chunk_idx * getColumns()];
+}
+
+template<typename T>
+void H5ChunkStats::_addRow(double *record, const T *row, hsize_t n)
+{
+  double low = record[min_column],
+         high = record[max_column],
+         sum = 0;
+  for(hsize_t i = 0; i < n; ++i)
+  {
+    double value = static_cast<double>(row[i]);
+    sum += value;
+    if(_isNaN(value))
+      continue;
+    low = (value < low ? value : low);
+    high = (value > high ? value : high);
+  }
+  record[min_column] = low;
+  record[max_column] = high;
+  record[sum_column] += sum;
+
+  if(bins == 0)
+    return;
+  double *counts = record + histogram_column,
+         scale = bins / (hist_max - hist_min);
+  for(hsize_t i = 0; i < n; ++i)
+  {
+    double value = static_cast<double>(row[i]);
+    if(_isNaN(value))
+      continue;
+    double position = (value - hist_min) * scale;
+    int bin;
+    if(!_isFinite(position))
+      bin = (_getBits(position) >> 63 ? 0 : bins - 1);
+    else
+      bin = (position < 0 ? 0 : (position >= bins ? bins - 1 : (int) position));
+    counts[bin] += 1;
+  }
+}
+
+/**
+ * @brief Add the data of one chunk to its record
+ * @details Different chunks may be added from different threads.
+ *
+ * @param layout chunk layout of the dataset (see H5ChunkIO::setupLayout)
+ * @param data the whole array, or a chunk buffer if in_chunk, in the type
+ * given to setup
+ */
+void H5ChunkStats::addChunk(H5ChunkIO &layout, hsize_t chunk_idx, const char *data, bool in_chunk)
+{
+  double *record = &records[chunk_idx * getColumns()];
+  int data_kind = kind;
+  layout.visitChunkRows(chunk_idx, data, elem_size, in_chunk, [&](const char *row, hsize_t n) {
+    if(data_kind == single)
+      _addRow(record, reinterpret_cast<const float *>(row), n);
+    else if(data_kind == twice)
+      _addRow(record, reinterpret_cast<const double *>(row), n);
+    else if(data_kind == int32)
+      _addRow(record, reinterpret_cast<const int32_t *>(row), n);
+    else if(data_kind == int64)
+      _addRow(record, reinterpret_cast<const int64_t *>(row), n);
+  });
+}
+
+/**
+ * @brief Fill the records of all chunks from the whole array on the pool
+ */
+void H5ChunkStats::compute(H5ChunkIO &layout, const void *array, H5ThreadPool &pool)
+{
+  const char *data = (const char *) array;
+  pool.parallelFor(num_chunks, [&](size_t i) {
+    addChunk(layout, i, data, false);
+  });
+}
+
+/**
+ * @brief Find the chunks whose range of values overlaps [min_in, max_in]
+ *
+ * @param chunks_out chunk numbers, in increasing order
+ */
+void H5ChunkStats::findChunks(double min_in, double max_in, std::vector<hsize_t> &chunks_out) const
+{
+  chunks_out.clear();
+  for(hsize_t i = 0; i < num_chunks; ++i)
+  {
+    const double *record = getRecord(i);
+    if(record[max_column] >= min_in && record[min_column] <= max_in)
+      chunks_out.push_back(i);
+  }
+}
+
+/**
+ * @brief Write the records to a [chunks][getColumns()] double dataset
+ */
+bool H5ChunkStats::write(hid_t index_id)
+{
+  return (records.empty() || H5Dwrite(index_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &records[0]) >= 0)
+    && _writeAttribute(index_id, "histogram_min", hist_min) && _writeAttribute(index_id, "histogram_max", hist_max);
+}
+
+/**
+ * @brief Read records written by write
+ */
+bool H5ChunkStats::read(hid_t index_id)
+{
+  hid_t space = H5Dget_space(index_id);
+  hsize_t dims[2] = {0, 0};
+  bool shaped = H5Sget_simple_extent_ndims(space) == 2 && H5Sget_simple_extent_dims(space, dims, NULL) >= 0
+    && dims[1] >= histogram_column;
+  H5Sclose(space);
+  if(!shaped || !_readAttribute(index_id, "histogram_min", hist_min) || !_readAttribute(index_id, "histogram_max", hist_max))
+    return false;
+
+  num_chunks = dims[0];
+  bins = dims[1] - histogram_column;
+  records.resize(dims[0] * dims[1]);
+  return records.empty() || H5Dread(index_id, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, &records[0]) >= 0;
+}
+
+std::string H5ChunkStats::getIndexName(std::string dset_name)
+{
+  return dset_name + "_chunkstats";
+}
@@ -0,0 +1,70 @@
+#ifndef H5ChunkStats_h
+#define H5ChunkStats_h
+
+#include <hdf5.h>
+#include <string>
+#include <vector>
+#include "H5ThreadPool.h"
+
+class H5ChunkIO;
+
+/**
+ * @brief Minimum, maximum, sum and an optional histogram of each chunk
+ * @details One record of doubles per chunk: min, max, sum, then the
+ * counts of bins equal bins between a histogram minimum and maximum
+ * (values outside go to the first or last bin). Stored as a 2D
+ * [chunks][columns] double dataset with "histogram_min" and
+ * "histogram_max" attributes, the records let reads skip chunks that
+ * cannot hold values of interest (see findChunks).
+ *
+ * The index of a dataset "name" is stored as "name_chunkstats" (see
+ * getIndexName).
+ *
+ * Available for native floats, doubles, int32s and int64s. NaNs are left
+ * out of minima, maxima and histograms, but make sums NaN.
+ */
+class H5ChunkStats
+{
+private:
+  int kind, //type of the data, see H5ChunkStats.cpp
+      bins;
+
+  size_t elem_size;
+
+  double hist_min,
+         hist_max;
+
+  hsize_t num_chunks;
+
+  std::vector<double> records; //num_chunks records of getColumns() values
+
+  template<typename T>
+  void _addRow(double *record, const T *row, hsize_t n);
+
+public:
+  enum column {min_column, max_column, sum_column, histogram_column};
+
+  H5ChunkStats();
+
+  bool setup(hid_t type, hsize_t num_chunks_in, int bins_in, double hist_min_in, double hist_max_in);
+
+  int getColumns() const;
+
+  hsize_t getNumChunks() const;
+
+  const double * getRecord(hsize_t chunk_idx) const;
+
+  void addChunk(H5ChunkIO &layout, hsize_t chunk_idx, const char *data, bool in_chunk);
+
+  void compute(H5ChunkIO &layout, const void *array, H5ThreadPool &pool);
+
+  void findChunks(double min_in, double max_in, std::vector<hsize_t> &chunks_out) const;
+
+  bool write(hid_t index_id);
+
+  bool read(hid_t index_id);
+
+  static std::string getIndexName(std::string dset_name);
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include <hdf5.h>
+#include <vector>
+#include "H5LibraryLock.h"
+#include "H5Compression.h"
+
+/**
+ * @brief Default compression: deflate (gzip) at level 9
+ */
+H5Compression::H5Compression()
+: compression_method(deflate), compression_level(9) { }
+
+/**
+ * @brief Compression with a given method and level
+ * @details The meaning of level depends on the method:
+ * - deflate, shuffle_deflate: gzip level 0-9
+ * - scaleoffset: decimal digits kept for floating point data (lossy),
+ *   minimum bits for integer data (0 lets HDF5 choose; lossless)
+ * - zstd: zstd level 1-22
+ * - none, nbit, lz4: unused
+ *
+ * @param method_in one of enum method
+ * @param level_in compression level
+ */
+H5Compression::H5Compression(int method_in, int level_in)
+: compression_method(method_in), compression_level(level_in) { }
+
+void H5Compression::setMethod(int method_in)
+{
+  compression_method = method_in;
+}
+
+void H5Compression::setLevel(int level_in)
+{
+  compression_level = level_in;
+}
+
+int H5Compression::getMethod() const
+{
+  return compression_method;
+}
+
+int H5Compression::getLevel() const
+{
+  return compression_level;
+}
+
+/**
+ * @brief Check if the library can both encode and decode with a filter
+ */
+static bool _filterAvailable(H5Z_filter_t filter)
+{
+  unsigned int filter_info;
+  H5E_auto2_t error_func;
+  void *error_out;
+
+  // missing plugins are expected; don't print the error stack (checked
+  // once per process, so swapping the handler here is fine)
+  H5LibraryLock library_lock;
+  H5Eget_auto(H5E_DEFAULT, &error_func, &error_out);
+  H5Eset_auto(H5E_DEFAULT, NULL, NULL);
+  htri_t avail = H5Zfilter_avail(filter);
+  herr_t status = (avail > 0 ? H5Zget_filter_info(filter, &filter_info) : -1);
+  H5Eset_auto(H5E_DEFAULT, error_func, error_out);
+
+  return status >= 0
+    && (filter_info & H5Z_FILTER_CONFIG_ENCODE_ENABLED)
+    && (filter_info & H5Z_FILTER_CONFIG_DECODE_ENABLED);
+}
+
+static std::vector<bool> _checkAvailability()
+{
+  std::vector<bool> avail(H5Compression::num_methods, false);
+  bool gzip = _filterAvailable(H5Z_FILTER_DEFLATE);
+  avail[H5Compression::none] = true;
+  avail[H5Compression::deflate] = gzip;
+  avail[H5Compression::shuffle_deflate] = gzip && _filterAvailable(H5Z_FILTER_SHUFFLE);
+  avail[H5Compression::scaleoffset] = _filterAvailable(H5Z_FILTER_SCALEOFFSET);
+  avail[H5Compression::nbit] = _filterAvailable(H5Z_FILTER_NBIT);
+  avail[H5Compression::lz4] = _filterAvailable(H5Z_FILTER_LZ4);
+  avail[H5Compression::zstd] = _filterAvailable(H5Z_FILTER_ZSTD);
+  return avail;
+}
+
+/**
+ * @brief Which methods are available, indexed by enum method
+ * @details Computed on first use only; third-party filters are loaded from
+ * HDF5_PLUGIN_PATH by this check if they are installed there.
+ */
+const std::vector<bool> & H5Compression::_availability()
+{
+  static const std::vector<bool> avail = _checkAvailability();
+  return avail;
+}
+
+/**
+ * @brief Check if a compression method can be used
+ *
+ * @param method_in one of enum method
+ */
+bool H5Compression::available(int method_in)
+{
+  if(method_in < 0 || method_in >= num_methods)
+    return false;
+  return _availability()[method_in];
+}
+
+/**
+ * @brief Add filters for this compression to a dataset creation plist
+ * @details If the method is not available, deflate (with the level limited
+ * to 0-9) is used instead, or no compression if deflate is unavailable too.
+ *
+ * @param dcpl_id chunked dataset creation property list
+ * @param type_id type of the dataset in the file
+ *
+ * @return the method actually applied
+ */
+int H5Compression::apply(hid_t dcpl_id, hid_t type_id) const
+{
+  int method_used = compression_method;
+  int level = compression_level;
+
+  if(!available(method_used))
+  {
+    method_used = (available(deflate) ? (int) deflate : (int) none);
+    if(level > 9)
+      level = 9;
+  }
+  if(level < 0)
+    level = 0;
+
+  unsigned int zstd_level = level;
+  switch(method_used)
+  {
+    case deflate:
+      H5Pset_deflate(dcpl_id, (level > 9 ? 9 : level));
+      break;
+    case shuffle_deflate:
+      H5Pset_shuffle(dcpl_id);
+      H5Pset_deflate(dcpl_id, (level > 9 ? 9 : level));
+      break;
+    case scaleoffset:
+      if(H5Tget_class(type_id) == H5T_FLOAT)
+        H5Pset_scaleoffset(dcpl_id, H5Z_SO_FLOAT_DSCALE, level);
+      else
+        H5Pset_scaleoffset(dcpl_id, H5Z_SO_INT, level);
+      break;
+    case nbit:
+      H5Pset_nbit(dcpl_id);
+      break;
+    case lz4:
+      H5Pset_filter(dcpl_id, H5Z_FILTER_LZ4, H5Z_FLAG_OPTIONAL, 0, NULL);
+      break;
+    case zstd:
+      H5Pset_filter(dcpl_id, H5Z_FILTER_ZSTD, H5Z_FLAG_OPTIONAL, 1, &zstd_level);
+      break;
+    default:
+      method_used = none;
+      break;
+  }
+
+  return method_used;
+}
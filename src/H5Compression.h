@@ -0,0 +1,49 @@
+#ifndef H5Compression_h
+#define H5Compression_h
+
+#include <hdf5.h>
+#include <vector>
+
+// Registered ids of third-party filters (https://portal.hdfgroup.org/display/support/Filters)
+#ifndef H5Z_FILTER_LZ4
+#define H5Z_FILTER_LZ4 32004
+#endif
+#ifndef H5Z_FILTER_ZSTD
+#define H5Z_FILTER_ZSTD 32015
+#endif
+
+/**
+ * @brief Compression settings for a dataset
+ * @details Holds a compression method and level and knows how to add the
+ * matching filters to a dataset creation property list. Which filters the
+ * linked HDF5 library can use is checked once per process.
+ */
+class H5Compression
+{
+private:
+  int compression_method,
+      compression_level;
+
+  static const std::vector<bool> & _availability();
+
+public:
+  enum method {none, deflate, shuffle_deflate, scaleoffset, nbit, lz4, zstd, num_methods};
+
+  H5Compression();
+
+  H5Compression(int method_in, int level_in);
+
+  void setMethod(int method_in);
+
+  void setLevel(int level_in);
+
+  int getMethod() const;
+
+  int getLevel() const;
+
+  static bool available(int method_in);
+
+  int apply(hid_t dcpl_id, hid_t type_id) const;
+};
+
+#endif
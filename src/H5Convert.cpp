@@ -0,0 +1,226 @@
+#include <hdf5.h>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <stdint.h>
+#include "H5ThreadPool.h"
+#include "H5Convert.h"
+
+namespace
+{
+
+enum kind {other, half, single, twice, int32, int64};
+
+const size_t H5CONVERT_BLOCK = 1 << 16; //elements converted per task
+
+/**
+ * @brief Check for a 16-bit IEEE float in native byte order
+ */
+bool _isHalf(hid_t type)
+{
+  if(H5Tget_class(type) != H5T_FLOAT || H5Tget_size(type) != 2
+      || H5Tget_order(type) != H5Tget_order(H5T_NATIVE_FLOAT) || H5Tget_ebias(type) != 15)
+    return false;
+  size_t spos, epos, esize, mpos, msize;
+  H5Tget_fields(type, &spos, &epos, &esize, &mpos, &msize);
+  return spos == 15 && epos == 10 && esize == 5 && mpos == 0 && msize == 10;
+}
+
+int _getKind(hid_t type)
+{
+  if(H5Tequal(type, H5T_NATIVE_FLOAT) > 0)
+    return single;
+  if(H5Tequal(type, H5T_NATIVE_DOUBLE) > 0)
+    return twice;
+  if(H5Tequal(type, H5T_NATIVE_INT32) > 0)
+    return int32;
+  if(H5Tequal(type, H5T_NATIVE_INT64) > 0)
+    return int64;
+  if(_isHalf(type))
+    return half;
+  return other;
+}
+
+/**
+ * @brief Round a float to the nearest half, ties to even
+ */
+inline uint16_t _floatToHalf(float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t abs = bits & 0x7fffffff;
+
+  if(abs > 0x7f800000) // nan, as HDF5 writes them
+    return sign | 0x7fff;
+  if(abs == 0x7f800000)
+    return sign | 0x7c00;
+  if(abs >= 0x477ff000) // rounds past the largest half
+    return sign | 0x7c00;
+  if(abs >= 0x38800000) // normal half
+  {
+    abs += 0xc8000fff + ((abs >> 13) & 1); // rebias exponent and round
+    return sign | (abs >> 13);
+  }
+
+  uint32_t exponent = abs >> 23;
+  if(exponent < 102) // below half the smallest subnormal
+    return sign;
+  uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+  int shift = 126 - exponent;
+  uint32_t result = mantissa >> shift,
+           rest = mantissa & ((1u << shift) - 1),
+           halfway = 1u << (shift - 1);
+  if(rest > halfway || (rest == halfway && (result & 1)))
+    ++result;
+  return sign | result;
+}
+
+inline float _halfToFloat(uint16_t value)
+{
+  uint32_t sign = (uint32_t) (value & 0x8000) << 16,
+           exponent = (value >> 10) & 0x1f,
+           mantissa = value & 0x3ff,
+           bits;
+
+  if(exponent == 0x1f)
+    bits = sign | (mantissa ? 0x7fffffff : 0x7f800000); // nans as HDF5 writes them
+  else if(exponent != 0)
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  else if(mantissa == 0)
+    bits = sign;
+  else
+  {
+    // subnormal half; normalize
+    exponent = 113;
+    while(!(mantissa & 0x400))
+    {
+      mantissa <<= 1;
+      --exponent;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+template<typename S, typename D>
+struct H5ConvertKernel
+{
+  static void run(const S *src, D *dst, size_t n)
+  {
+    for(size_t i = 0; i < n; ++i)
+      dst[i] = static_cast<D>(src[i]);
+  }
+};
+
+template<>
+struct H5ConvertKernel<int64_t, int32_t>
+{
+  static void run(const int64_t *src, int32_t *dst, size_t n)
+  {
+    for(size_t i = 0; i < n; ++i)
+      dst[i] = static_cast<int32_t>(std::min<int64_t>(std::max<int64_t>(src[i], INT32_MIN), INT32_MAX));
+  }
+};
+
+template<>
+struct H5ConvertKernel<float, uint16_t>
+{
+  static void run(const float *src, uint16_t *dst, size_t n)
+  {
+    for(size_t i = 0; i < n; ++i)
+      dst[i] = _floatToHalf(src[i]);
+  }
+};
+
+template<>
+struct H5ConvertKernel<uint16_t, float>
+{
+  static void run(const uint16_t *src, float *dst, size_t n)
+  {
+    for(size_t i = 0; i < n; ++i)
+      dst[i] = _halfToFloat(src[i]);
+  }
+};
+
+/**
+ * @brief Convert n elements in blocks on the pool
+ */
+template<typename S, typename D>
+void _convertParallel(const void *src, void *dst, size_t n, H5ThreadPool &pool)
+{
+  const S *typed_src = static_cast<const S *>(src);
+  D *typed_dst = static_cast<D *>(dst);
+  size_t blocks = (n + H5CONVERT_BLOCK - 1) / H5CONVERT_BLOCK;
+  if(blocks <= 1 || pool.getThreads() <= 1)
+  {
+    H5ConvertKernel<S, D>::run(typed_src, typed_dst, n);
+    return;
+  }
+
+  pool.parallelFor(blocks, [&](size_t b) {
+    size_t first = b * H5CONVERT_BLOCK;
+    H5ConvertKernel<S, D>::run(typed_src + first, typed_dst + first, std::min(H5CONVERT_BLOCK, n - first));
+  });
+}
+
+} // namespace
+
+/**
+ * @brief Make a 16-bit IEEE float type
+ * @details For storing floats as halves with H5IO::setDatasetType. Close
+ * it with H5Tclose.
+ */
+hid_t H5Convert::createHalfType()
+{
+  hid_t type = H5Tcopy(H5T_NATIVE_FLOAT);
+  H5Tset_fields(type, 15, 10, 5, 0, 10);
+  H5Tset_precision(type, 16);
+  H5Tset_size(type, 2);
+  H5Tset_ebias(type, 15);
+  return type;
+}
+
+/**
+ * @brief Check if convert handles a pair of types
+ */
+bool H5Convert::supported(hid_t src_type, hid_t dst_type)
+{
+  int src = _getKind(src_type), dst = _getKind(dst_type);
+  return (src == twice && dst == single) || (src == single && dst == twice)
+    || (src == single && dst == half) || (src == half && dst == single)
+    || (src == int64 && dst == int32) || (src == int32 && dst == int64);
+}
+
+/**
+ * @brief Convert n elements of src_type to dst_type
+ *
+ * @param src n contiguous elements of src_type
+ * @param dst space for n elements of dst_type
+ * @param pool threads to convert on
+ *
+ * @return false if the pair of types is not supported; nothing is converted then
+ */
+bool H5Convert::convert(hid_t src_type, hid_t dst_type, const void *src, void *dst, size_t n, H5ThreadPool &pool)
+{
+  int src_kind = _getKind(src_type), dst_kind = _getKind(dst_type);
+
+  if(src_kind == twice && dst_kind == single)
+    _convertParallel<double, float>(src, dst, n, pool);
+  else if(src_kind == single && dst_kind == twice)
+    _convertParallel<float, double>(src, dst, n, pool);
+  else if(src_kind == single && dst_kind == half)
+    _convertParallel<float, uint16_t>(src, dst, n, pool);
+  else if(src_kind == half && dst_kind == single)
+    _convertParallel<uint16_t, float>(src, dst, n, pool);
+  else if(src_kind == int64 && dst_kind == int32)
+    _convertParallel<int64_t, int32_t>(src, dst, n, pool);
+  else if(src_kind == int32 && dst_kind == int64)
+    _convertParallel<int32_t, int64_t>(src, dst, n, pool);
+  else
+    return false;
+  return true;
+}
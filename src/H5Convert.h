@@ -0,0 +1,30 @@
+#ifndef H5Convert_h
+#define H5Convert_h
+
+#include <hdf5.h>
+#include <cstddef>
+#include "H5ThreadPool.h"
+
+/**
+ * @brief Type conversion of contiguous arrays on a thread pool
+ * @details Converts the common pairs double <-> float, float <-> half and
+ * int64 <-> int32 (native byte order) with plain loops the compiler can
+ * vectorize, split across the threads of a pool. Results are the same as
+ * HDF5's: floats round to nearest even, values too large for a floating
+ * point type become infinite, and integers are clamped to the target range.
+ * The exception is float to half, which HDF5 converts in software: it
+ * rounds ties away from zero and mishandles some carries and subnormals,
+ * so its halves can differ from these, which are correctly rounded.
+ * Other pairs are left to HDF5.
+ */
+class H5Convert
+{
+public:
+  static hid_t createHalfType();
+
+  static bool supported(hid_t src_type, hid_t dst_type);
+
+  static bool convert(hid_t src_type, hid_t dst_type, const void *src, void *dst, size_t n, H5ThreadPool &pool);
+};
+
+#endif
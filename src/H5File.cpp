@@ -0,0 +1,290 @@
+#include <hdf5.h>
+#include <string>
+#include <map>
+#include <cstdio>
+#include "H5LibraryLock.h"
+#include "H5File.h"
+
+H5File::H5File()
+: name(""), id(-1), access_plist(H5P_DEFAULT), dataset_plist(H5P_DEFAULT)
+{
+  H5LibraryLock library_lock;
+  link_plist = H5Pcreate(H5P_LINK_CREATE);
+  H5Pset_create_intermediate_group(link_plist, 1);
+}
+
+H5File::~H5File()
+{
+  H5LibraryLock library_lock;
+  close();
+  if(access_plist != H5P_DEFAULT)
+    H5Pclose(access_plist);
+  if(dataset_plist != H5P_DEFAULT)
+    H5Pclose(dataset_plist);
+  H5Pclose(link_plist);
+}
+
+/**
+ * @brief Remember that the group path (and so each group above it) exists
+ * @details Also takes the path of an object, whose parent groups are added.
+ */
+void H5File::_addGroups(std::string path)
+{
+  size_t end = path.find_last_of('/');
+  while(end != std::string::npos && end > 0)
+  {
+    path.resize(end);
+    if(!groups.insert(path).second)
+      break;
+    end = path.find_last_of('/');
+  }
+}
+
+/**
+ * @brief Find what is at a path of the open file
+ * @details Walks the path one link at a time with H5Lexists, which fails
+ * (and prints errors) for paths through missing groups, so only ever
+ * looks up links in groups known to exist. Groups found on the way are
+ * remembered.
+ *
+ * @param path path of an object
+ * @param object_id if not NULL, receives the open object when there is one
+ * (close it with H5Oclose)
+ * @return the type of the object; H5I_BADID if there is none. If an
+ * object in the path is not a group, its type is returned instead.
+ */
+H5I_type_t H5File::_probe(std::string path, hid_t *object_id)
+{
+  size_t end = 0;
+  while(true)
+  {
+    end = path.find('/', end + 1);
+    std::string part = path.substr(0, end);
+    bool last = (end == std::string::npos);
+    if(!last && (part.empty() || groups.count(part)))
+      continue;
+
+    if(H5Lexists(id, part.c_str(), H5P_DEFAULT) <= 0 || H5Oexists_by_name(id, part.c_str(), H5P_DEFAULT) <= 0)
+      return H5I_BADID;
+    hid_t object = H5Oopen(id, part.c_str(), H5P_DEFAULT);
+    H5I_type_t type = H5Iget_type(object);
+    if(last && object_id)
+      *object_id = object;
+    else
+      H5Oclose(object);
+
+    if(last || type != H5I_GROUP)
+      return type;
+    groups.insert(part);
+  }
+}
+
+/**
+ * @brief Set file access property list used when files are opened
+ * @details A copy of fapl_id is kept, so the caller may close it. Takes
+ * effect the next time a file is opened.
+ *
+ * @param fapl_id file access property list, or H5P_DEFAULT
+ */
+void H5File::setAccessPList(hid_t fapl_id)
+{
+  if(access_plist != H5P_DEFAULT)
+    H5Pclose(access_plist);
+  access_plist = (fapl_id == H5P_DEFAULT ? H5P_DEFAULT : H5Pcopy(fapl_id));
+}
+
+/**
+ * @brief Set dataset access property list used when datasets are opened
+ * @details A copy of dapl_id is kept, so the caller may close it. Takes
+ * effect for datasets opened (or created) from now on.
+ *
+ * @param dapl_id dataset access property list, or H5P_DEFAULT
+ */
+void H5File::setDatasetAccessPList(hid_t dapl_id)
+{
+  if(dataset_plist != H5P_DEFAULT)
+    H5Pclose(dataset_plist);
+  dataset_plist = (dapl_id == H5P_DEFAULT ? H5P_DEFAULT : H5Pcopy(dapl_id));
+}
+
+hid_t H5File::getDatasetAccessPList()
+{
+  return dataset_plist;
+}
+
+/**
+ * @brief Open a file, creating it if it does not exist
+ * @details Does nothing if file_name is already open. If another file is
+ * open it (and all of its datasets) is closed first.
+ *
+ * @param file_name name of file to open
+ * @param read_flag if true, do not create the file when it is missing
+ *
+ * @return true if the file is open afterwards
+ */
+bool H5File::open(std::string file_name, bool read_flag)
+{
+  if(isOpen(file_name))
+    return true;
+
+  close();
+
+  // file images are opened from memory; other files must be on disk
+  size_t image_bytes = 0;
+  if(access_plist != H5P_DEFAULT)
+    H5Pget_file_image(access_plist, NULL, &image_bytes);
+  std::FILE *disk_file = (image_bytes ? NULL : std::fopen(file_name.c_str(), "rb"));
+  if(disk_file)
+    std::fclose(disk_file);
+
+  if(image_bytes || disk_file)
+    id = H5Fopen(file_name.c_str(), H5F_ACC_RDWR, access_plist);
+  else if(!read_flag)
+    id = H5Fcreate(file_name.c_str(), H5F_ACC_EXCL, H5P_DEFAULT, access_plist);
+  if(id < 0)
+    return false;
+
+  name = file_name;
+  return true;
+}
+
+bool H5File::isOpen()
+{
+  return id >= 0;
+}
+
+bool H5File::isOpen(std::string file_name)
+{
+  return id >= 0 && name == file_name;
+}
+
+hid_t H5File::getId()
+{
+  return id;
+}
+
+/**
+ * @brief Link creation property list that creates missing groups
+ * @details For H5Dcreate and H5Gcreate; owned by the file.
+ */
+hid_t H5File::getLinkPList()
+{
+  return link_plist;
+}
+
+std::string H5File::getName()
+{
+  return name;
+}
+
+/**
+ * @brief Get id of a dataset in the open file
+ * @details Returns the cached id if the dataset has been opened before,
+ * otherwise opens it and caches the id.
+ *
+ * @param dset_name path to dataset
+ * @return dataset id, or a negative value if the dataset does not exist
+ */
+hid_t H5File::openDataset(std::string dset_name)
+{
+  std::map<std::string, hid_t>::iterator it = datasets.find(dset_name);
+  if(it != datasets.end())
+    return it->second;
+
+  // no object comes back when a dataset blocks the path
+  hid_t dset_id = -1;
+  if(_probe(dset_name, &dset_id) != H5I_DATASET || dset_id < 0)
+  {
+    if(dset_id >= 0)
+      H5Oclose(dset_id);
+    return -1;
+  }
+  if(dataset_plist != H5P_DEFAULT)
+  {
+    H5Oclose(dset_id);
+    dset_id = H5Dopen(id, dset_name.c_str(), dataset_plist);
+  }
+
+  if(dset_id >= 0)
+  {
+    datasets[dset_name] = dset_id;
+    _addGroups(dset_name);
+  }
+  return dset_id;
+}
+
+/**
+ * @brief Hand an already open dataset id to the file to be cached
+ * @details The file takes ownership of the id and closes it in close().
+ */
+void H5File::addDataset(std::string dset_name, hid_t dset_id)
+{
+  closeDataset(dset_name);
+  datasets[dset_name] = dset_id;
+  _addGroups(dset_name);
+}
+
+void H5File::closeDataset(std::string dset_name)
+{
+  std::map<std::string, hid_t>::iterator it = datasets.find(dset_name);
+  if(it != datasets.end())
+  {
+    H5Dclose(it->second);
+    datasets.erase(it);
+  }
+}
+
+/**
+ * @brief Make sure a group and all groups above it exist
+ * @details Groups already known to exist are not looked up; missing ones
+ * are created in one H5Gcreate.
+ *
+ * @param group_name path of group
+ * @return false if the group could not be created (eg. another object
+ * is in its path)
+ */
+bool H5File::createGroups(std::string group_name)
+{
+  if(group_name.empty() || group_name == "/" || groups.count(group_name))
+    return true;
+
+  H5I_type_t type = _probe(group_name, NULL);
+  if(type == H5I_BADID)
+  {
+    hid_t group_id = H5Gcreate(id, group_name.c_str(), link_plist, H5P_DEFAULT, H5P_DEFAULT);
+    if(group_id < 0)
+      return false;
+    H5Gclose(group_id);
+  }
+  else if(type != H5I_GROUP)
+    return false;
+  _addGroups(group_name + "/");
+  return true;
+}
+
+/**
+ * @brief Flush buffered data of the open file to disk
+ */
+herr_t H5File::flush()
+{
+  if(!isOpen())
+    return 0;
+  return H5Fflush(id, H5F_SCOPE_GLOBAL);
+}
+
+/**
+ * @brief Close all cached datasets and the file itself
+ */
+void H5File::close()
+{
+  std::map<std::string, hid_t>::iterator it;
+  for(it = datasets.begin(); it != datasets.end(); ++it)
+    H5Dclose(it->second);
+  datasets.clear();
+  groups.clear();
+
+  if(isOpen())
+    H5Fclose(id);
+  id = -1;
+  name = "";
+}
@@ -0,0 +1,74 @@
+#ifndef H5File_h
+#define H5File_h
+
+#include <hdf5.h>
+#include <string>
+#include <map>
+#include <set>
+
+/**
+ * @brief Handle to an open HDF5 file and the datasets opened in it
+ * @details Keeps the file id and every dataset id opened through it alive
+ * until close() is called, so repeated reads and writes to the same file do
+ * not pay for reopening the file and its datasets each time. Groups known to
+ * exist are remembered too, so their paths are not probed again.
+ *
+ * Missing files, groups and datasets are detected without failing HDF5
+ * calls, so HDF5's error printing never has to be switched off (it is
+ * process-wide in HDF5 builds without thread safety).
+ */
+class H5File
+{
+private:
+  std::string name;
+
+  hid_t id,
+        access_plist, //file access property list used to open files
+        dataset_plist, //dataset access property list used to open datasets
+        link_plist; //link creation property list creating intermediate groups
+
+  std::map<std::string, hid_t> datasets; //open dataset ids by path
+
+  std::set<std::string> groups; //paths of groups known to exist
+
+  void _addGroups(std::string path);
+
+  H5I_type_t _probe(std::string path, hid_t *object_id);
+
+public:
+  H5File();
+
+  ~H5File();
+
+  void setAccessPList(hid_t fapl_id);
+
+  void setDatasetAccessPList(hid_t dapl_id);
+
+  hid_t getDatasetAccessPList();
+
+  bool open(std::string file_name, bool read_flag);
+
+  bool isOpen();
+
+  bool isOpen(std::string file_name);
+
+  hid_t getId();
+
+  hid_t getLinkPList();
+
+  std::string getName();
+
+  hid_t openDataset(std::string dset_name);
+
+  void addDataset(std::string dset_name, hid_t dset_id);
+
+  void closeDataset(std::string dset_name);
+
+  bool createGroups(std::string group_name);
+
+  herr_t flush();
+
+  void close();
+};
+
+#endif
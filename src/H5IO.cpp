@@ -1,12 +1,26 @@
 #include <hdf5.h>
 #include <iostream>
 #include <string>
-#include <sstream>
 #include <vector>
-#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
 
 #include "H5SizeArray.h"
 #include "H5SParams.h"
+#include "H5File.h"
+#include "H5ThreadPool.h"
+#include "H5ChunkIO.h"
+#include "H5IOStats.h"
+#include "H5Pack.h"
+#include "H5Pyramid.h"
+#include "H5ChunkStats.h"
+#include "H5LibraryLock.h"
 #include "H5IO.h"
 
 #define S1(x) #x
@@ -15,8 +29,17 @@
 
 #define H5IO_VERBOSE_COUT if( verbosity_level >= verbose ) std::cout << \
   (verbosity_level == debug ? LOCATION : "")
+// HDF5 does not allow chunks of 4 GB or more
+#define H5IO_MAX_CHUNK_BYTES 4294967295ULL
+
 #define H5IO_DEBUG_COUT if( verbosity_level == debug ) std::cout << LOCATION
 
+// held while HDF5 is used, in HDF5 builds that are not thread safe
+#define H5IO_LOCK_LIBRARY H5LibraryLock library_lock
+
+// held while settings used by the background I/O thread change
+#define H5IO_LOCK_SETTINGS std::lock_guard<std::mutex> settings_lock(settings_mutex)
+
 /**
  * @brief Private initialization function
  * @details Initializes the member elements of the H5IO class.
@@ -28,9 +51,37 @@
  */
 void H5IO::_initialize(int mem_rank_in, H5SizeArray &mem_dims_in, hid_t mem_type_in)
 {
-  H5IO_DEBUG_COUT << "Stashing H5 error handeling parameters..." << std::flush;
-  H5IO_DEBUG_COUT << "Done!" << std::endl;
-  compression_level = 9;
+  H5IO_LOCK_LIBRARY;
+  verbosity_level = off;
+  persistent_file = true;
+  append_buffer_rows = 1;
+  append_chunk_rows = 0;
+  parallel_compression = false;
+  file_slab_set = false;
+  overwrite = false;
+  incremental = false;
+  pyramid_levels = 0;
+  pyramid_method = H5Pyramid::mean;
+  subfiles = 0;
+  subfile_axis = 0;
+  chunk_stats_enabled = false;
+  chunk_stats_fused = false;
+  chunk_stats_bins = 0;
+  chunk_stats_min = 0;
+  chunk_stats_max = 0;
+  type_check = false;
+  chunk_hashes = std::make_shared<ChunkHashes>();
+  dset_xfer_plist = H5P_DEFAULT;
+#ifdef H5IO_MPI
+  mpi_enabled = false;
+#endif
+  async_queue_size = 2;
+  async_busy = false;
+  async_stop = false;
+  chunk_mode = chunk_whole;
+  chunk_target_bytes = 1 << 20;
+  file_id = -1;
+  dset_id = -1;
   mem_dspace.type=mem_type_in;
   dset_dspace.type=mem_type_in;
   mem_dspace.setDefaults(mem_rank_in, mem_dims_in);
@@ -39,110 +90,69 @@ void H5IO::_initialize(int mem_rank_in, H5SizeArray &mem_dims_in, hid_t mem_type
 }
 
 /**
- * @brief Pause H5's default error handeling
- * @details Enables you to run checks on H5 comands you expect to fail. 
- * 		Saves defaults to member variables default_error_func and default_error_out.
+ * @brief Make file_name the open file
+ * @details Reuses the open file if it is already file_name, otherwise
+ * closes whatever file was open and opens (or creates) file_name.
  *
+ * @param file_name name of file
+ * @param read_flag if true, do not create the file when it is missing
  */
-void H5IO::_pauseH5ErrorHandeling()
-{
-  H5Eget_auto(H5E_DEFAULT, &default_error_func, &default_error_out);
-  H5Eset_auto(H5E_DEFAULT,NULL,NULL);
-}
-
-/**
- * @brief Resume H5's default error handeling
- * @details Restores H5's error handeling using the saved defaults 
- * 		in member variables default_error_func and default_error_out.
- */
-void H5IO::_resumeH5ErrorHandeling()
-{
-  H5Eset_auto(H5E_DEFAULT,default_error_func,default_error_out);
-}
-
 bool H5IO::_openOrCreateFile(std::string file_name, bool read_flag)
 {
-  H5IO_DEBUG_COUT << "Seeing if file exists..." << std::flush;
-  _pauseH5ErrorHandeling();
-  file_id = H5Fopen(file_name.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
-  _resumeH5ErrorHandeling();
+  if(file.isOpen(file_name))
+  {
+    H5IO_DEBUG_COUT << "File already open." << std::endl;
+    file_id = file.getId();
+    return true;
+  }
 
-  if(file_id < 0)
+  H5IO_DEBUG_COUT << "Opening or creating file..." << std::flush;
+  H5IOStats::Timer timer(stats, H5IOStats::file_open);
+  if(!file.open(file_name, read_flag))
   {
     if(read_flag)
     {
       H5IO_DEBUG_COUT << "No such file." << std::endl;
       H5IO_VERBOSE_COUT << "No data to read: aborting read." << std::endl << std::flush;
-      return false;
     }
-    H5IO_DEBUG_COUT << "No such file." << std::endl << std::flush;
-    H5IO_DEBUG_COUT << "Creating file instead..." << std::flush;
-    file_id = H5Fcreate(file_name.c_str(), H5F_ACC_EXCL, H5P_DEFAULT, H5P_DEFAULT);
-  }
-  else
-  {
-    H5Fclose(file_id);
-    H5IO_DEBUG_COUT << "File exists." << std::endl << std::flush;
-    H5IO_DEBUG_COUT << "Opening file..." << std::flush;
-    file_id = H5Fopen(file_name.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+    else
+    {
+      H5IO_VERBOSE_COUT << "Could not open or create file '" << file_name << "'." << std::endl << std::flush;
+    }
+    return false;
   }
+  file_id = file.getId();
   H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
   return true;
 }
 
-bool H5IO::_checkCompression()
+/**
+ * @brief Make sure the groups above a dataset exist
+ * @details Groups this file already knows about are not probed again.
+ */
+bool H5IO::_createGroups(std::string &dset_name)
 {
-  unsigned int filter_info;
-  htri_t avail = H5Zfilter_avail(H5Z_FILTER_DEFLATE);
-  if(avail)
-  {
-    status = H5Zget_filter_info(H5Z_FILTER_DEFLATE, &filter_info);
-    if( (filter_info & H5Z_FILTER_CONFIG_ENCODE_ENABLED) && (filter_info & H5Z_FILTER_CONFIG_DECODE_ENABLED) )
-    {
-      return true;
-    }
-  }
-  H5IO_VERBOSE_COUT << "Cant compress with gzip. Turning off compression." << std::endl;
+  H5IOStats::Timer timer(stats, H5IOStats::group_create);
+  size_t last_slash = dset_name.find_last_of('/');
+  if(last_slash == std::string::npos || file.createGroups(dset_name.substr(0, last_slash)))
+    return true;
+
+  H5IO_VERBOSE_COUT << "Cannot create dataset: non-group object exists in path '" << dset_name << "'." << std::endl << std::flush;
   return false;
 }
 
- void H5IO::_split(const std::string &s, char delim, std::vector<std::string> &elems) {
-    std::stringstream ss(s);
-    std::string item;
-    while (std::getline(ss, item, delim)) {
-        elems.push_back(item);
-    }
+/**
+ * @brief Get dimensions of one appended row
+ * @details A row is the currently selected memory hyperslab.
+ */
+void H5IO::_getRowDims(std::vector<hsize_t> &row_dims)
+{
+  row_dims.resize(mem_dspace.getRank());
+  for(int i = 0; i < mem_dspace.getRank(); ++i)
+    row_dims[i] = mem_dspace.count[i] * mem_dspace.block[i];
 }
 
-
-bool H5IO::_createGroups(std::string &dset_name)
-{
-	hid_t temp_id;
-	std::string path_c="";
-	std::vector<std::string> path_b;
-	_split(dset_name,'/',path_b);
-	std::reverse(path_b.begin(),path_b.end());
-
-	while ((path_b.size()-1)) {
-	  if(!path_b.back().empty()) {
-	    path_c += "/" + path_b.back();
-	    std::cout << path_c<< std::endl;
-	    temp_id = H5Oopen(file_id,path_c.c_str(), H5P_DEFAULT);
-	    if(temp_id < 0)
-	      temp_id = H5Gcreate(file_id,path_c.c_str(),H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
-	    else if (H5I_GROUP != H5Iget_type(temp_id)) {
-	        H5IO_VERBOSE_COUT << "Cannot create dataset: non-group object exists with path '" << path_c <<"'." << std::endl << std::flush;
-	        H5Oclose(temp_id);
-	        return false;
-	    }
-	    H5Oclose(temp_id);
-	  }
-	  path_b.pop_back();
-	}
-	return true;
-}
-
-bool H5IO::_createCloseDatasetAppend(std::string dset_name)
+bool H5IO::_createOpenDatasetAppend(std::string dset_name, std::vector<hsize_t> &row_dims)
 {	
 	if(!_createGroups(dset_name))
 		return false;
@@ -150,12 +160,12 @@ bool H5IO::_createCloseDatasetAppend(std::string dset_name)
   H5IO_DEBUG_COUT << "Creating dataset for appending...." << std::endl << std::flush;
 
   H5IO_DEBUG_COUT << "  Formating dataspace..." << std::flush;
-  dset_dspace.setRank(mem_dspace.getRank()+1);
+  dset_dspace.setRank(row_dims.size()+1);
 
   dset_dspace.dims[0] = 0;
 
   for(int i = 1; i < dset_dspace.getRank(); ++i)
-    dset_dspace.dims[i] = mem_dspace.count[i-1] * mem_dspace.block[i-1];
+    dset_dspace.dims[i] = row_dims[i-1];
 
   dset_dspace.maxdims = dset_dspace.dims;
   dset_dspace.maxdims[0] = H5S_UNLIMITED;
@@ -166,319 +176,3021 @@ bool H5IO::_createCloseDatasetAppend(std::string dset_name)
   H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
 
   dset_dspace.chunk = dset_dspace.dims;
-  dset_dspace.chunk[0] = 1; // so that chunk has positive values
-  _setCompressionPList();
+  // rows per chunk; by default as many rows as are committed at once
+  dset_dspace.chunk[0] = (append_chunk_rows > 0 ? append_chunk_rows : append_buffer_rows);
+  _setCompressionPList(dset_name);
 
   H5IO_DEBUG_COUT << "  Creating dataset..." << std::flush;
-  dset_id = H5Dcreate(file_id, dset_name.c_str(), dset_dspace.type, dset_dspace.id, H5P_DEFAULT, dset_chunk_plist, H5P_DEFAULT);
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::dataset_create);
+    dset_id = H5Dcreate(file_id, dset_name.c_str(), dset_dspace.type, dset_dspace.id, file.getLinkPList(), dset_chunk_plist, file.getDatasetAccessPList());
+  }
   H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
 
   H5IO_DEBUG_COUT << "  Closing... " << std::flush;
-  status = H5Dclose(dset_id);
-  H5IO_DEBUG_COUT << "Dataset... " << std::flush;
   status = dset_dspace.closeSpace();
   H5IO_DEBUG_COUT << "Dataspace... " << std::flush;
   status = H5Pclose(dset_chunk_plist);
   H5IO_DEBUG_COUT << "Compression plist... Done!" << std::flush;
 
+  if(dset_id < 0)
+  {
+    H5IO_VERBOSE_COUT << "Could not create dataset '" << dset_name << "'." << std::endl << std::flush;
+    return false;
+  }
+  file.addDataset(dset_name, dset_id);
+
   H5IO_DEBUG_COUT << "Finisehd creating dataset!" << std::endl << std::flush;
   return true;
 }
 
-bool H5IO::_createOpenDataset(std::string dset_name)
-{ 
-  if(!_createGroups(dset_name))
+#ifdef H5IO_MPI
+/**
+ * @brief Collectively create a dataset with the global dimensions given to
+ * setMPI and select this rank's block of it
+ */
+bool H5IO::_createOpenDatasetMPI(std::string dset_name)
+{
+  int rank = mem_dspace.getRank();
+  dset_dspace.setRank(rank);
+  for(int i = 0; i < rank; ++i)
+    dset_dspace.dims[i] = mpi_global_dims[i];
+  dset_dspace.maxdims = dset_dspace.dims;
+
+  dset_dspace.createSpace();
+
+  _setChunkDims();
+  _setCompressionPList(dset_name);
+
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::dataset_create);
+    dset_id = H5Dcreate(file_id, dset_name.c_str(), dset_dspace.type, dset_dspace.id, file.getLinkPList(), dset_chunk_plist, file.getDatasetAccessPList());
+  }
+  H5Pclose(dset_chunk_plist);
+  if(dset_id < 0)
+  {
+    H5IO_VERBOSE_COUT << "Could not create dataset '" << dset_name << "'." << std::endl << std::flush;
+    dset_dspace.closeSpace();
     return false;
+  }
+  file.addDataset(dset_name, dset_id);
+
+  _selectMPIBlock();
+  return true;
+}
+
+/**
+ * @brief Select this rank's block in dset_dspace.id
+ */
+void H5IO::_selectMPIBlock()
+{
+  H5IOStats::Timer timer(stats, H5IOStats::hyperslab_select);
+  int rank = mem_dspace.getRank();
+  std::vector<hsize_t> count(rank);
+  for(int i = 0; i < rank; ++i)
+    count[i] = mem_dspace.count[i] * mem_dspace.block[i];
+  H5Sselect_hyperslab(dset_dspace.id, H5S_SELECT_SET, &mpi_offset[0], NULL, &count[0], NULL);
+}
+#endif
+
+/**
+ * @brief Get dimensions of the dataset writeArrayToFile creates
+ * @details The global dimensions under MPI, otherwise those of the memory
+ * selection without dimensions of extent 1.
+ */
+void H5IO::_getDatasetDims(std::vector<hsize_t> &dims)
+{
+  dims.clear();
+#ifdef H5IO_MPI
+  if(mpi_enabled)
+  {
+    dims = mpi_global_dims;
+    return;
+  }
+#endif
   // This shrinks the file dspace to be minimal dimensions i.e. if there is a
   // mem_dspace.dim that is 1 it will skip over unless all are one then it
   // sets the dset rank to 1 and dset_dspace.dim[0] = 1.
-  int new_rank = 0;
   for(int i = 0; i < mem_dspace.getRank(); ++i)
     if( mem_dspace.block[i] * mem_dspace.count[i] > 1 )
-      new_rank++;
+      dims.push_back(mem_dspace.block[i] * mem_dspace.count[i]);
 
-  if(new_rank == 0)
-  {
-    dset_dspace.setRank(1);
-    dset_dspace.dims[0] = 1;
-  }
-  else
-  {
-    dset_dspace.setRank(new_rank);
-    int j = 0;
-    for(int i = 0; i < mem_dspace.getRank(); ++i)
-      if( mem_dspace.block[i] * mem_dspace.count[i] > 1 )
-      {
-        dset_dspace.dims[j] = mem_dspace.block[i] * mem_dspace.count[i];
-        j++;
-      }
-  }
+  if(dims.empty())
+    dims.push_back(1);
+}
+
+bool H5IO::_createOpenDataset(std::string dset_name)
+{ 
+  if(!_createGroups(dset_name))
+    return false;
+#ifdef H5IO_MPI
+  if(mpi_enabled)
+    return _createOpenDatasetMPI(dset_name);
+#endif
+  std::vector<hsize_t> dims;
+  _getDatasetDims(dims);
+  dset_dspace.setRank(dims.size());
+  for(size_t i = 0; i < dims.size(); ++i)
+    dset_dspace.dims[i] = dims[i];
 
   dset_dspace.maxdims = dset_dspace.dims;
 
 
   dset_dspace.createSpace();
 
-  dset_dspace.chunk = dset_dspace.dims;
-  _setCompressionPList();
+  _setChunkDims();
+  _setCompressionPList(dset_name);
 
-  dset_id = H5Dcreate(file_id, dset_name.c_str(), dset_dspace.type, dset_dspace.id, H5P_DEFAULT, dset_chunk_plist, H5P_DEFAULT);
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::dataset_create);
+    dset_id = H5Dcreate(file_id, dset_name.c_str(), dset_dspace.type, dset_dspace.id, file.getLinkPList(), dset_chunk_plist, file.getDatasetAccessPList());
+  }
   H5Pclose(dset_chunk_plist);
+  if(dset_id < 0)
+  {
+    H5IO_VERBOSE_COUT << "Could not create dataset '" << dset_name << "'." << std::endl << std::flush;
+    dset_dspace.closeSpace();
+    return false;
+  }
+  file.addDataset(dset_name, dset_id);
   return true;
 }
 
-bool H5IO::_checkAppend()
+/**
+ * @brief Check that the open dataset can be overwritten by the array
+ * @details Its dimensions must be those writeArrayToFile would create and
+ * its type the dataset type. Sets dset_dspace.id to the selection to write.
+ */
+bool H5IO::_checkOverwrite()
 {
-  if(dset_dspace.getRank() == 1 + mem_dspace.getRank())
-  {
-    if(dset_dspace.maxdims[0] == H5S_UNLIMITED || dset_dspace.dims[0] <= dset_dspace.maxdims[0])
-    {
-      for( int i = 1; i < dset_dspace.getRank(); ++i )
-        if( dset_dspace.dims[i] != mem_dspace.count[i-1]*mem_dspace.block[i-1]) {
-          H5IO_DEBUG_COUT << "Here..." << i << dset_dspace.dims[i] << mem_dspace.count[i-1] << mem_dspace.block[i-1] << std::flush;
-          return false;
-        }
-      return true;
-    }
-  }
-  return false;
+  std::vector<hsize_t> new_dims;
+  _getDatasetDims(new_dims);
 
-}
+  dset_dspace.id = H5Dget_space(dset_id);
+  std::vector<hsize_t> dims(H5Sget_simple_extent_ndims(dset_dspace.id));
+  if(!dims.empty())
+    H5Sget_simple_extent_dims(dset_dspace.id, &dims[0], NULL);
 
-bool H5IO::_checkDatasetExists(std::string dset_name, bool read_flag)
-{
-  hid_t temp;
-   H5IO_DEBUG_COUT << "Seeing if dataset exists..." << std::flush;
-  _pauseH5ErrorHandeling();
-  temp = H5Dopen(file_id, dset_name.c_str(), H5P_DEFAULT);
-  _resumeH5ErrorHandeling();
+  hid_t file_type = H5Dget_type(dset_id);
+  bool same_type = H5Tequal(file_type, dset_dspace.type) > 0;
+  H5Tclose(file_type);
 
-  if( temp < 0 ) {
-    H5IO_DEBUG_COUT << "Dataset does not exist." << std::endl;
+  if(dims != new_dims || !same_type)
+  {
+    H5IO_VERBOSE_COUT << "Dataset has a different shape or type; can't overwrite it. Aborting write." << std::endl;
     return false;
   }
-  H5Dclose(temp);
-
-  if(read_flag)
-    dset_id = H5Dopen(file_id, dset_name.c_str(), H5P_DEFAULT);
-  H5IO_DEBUG_COUT << "Dataset exists!" << std::endl << std::flush;
+#ifdef H5IO_MPI
+  if(mpi_enabled)
+    _selectMPIBlock();
+#endif
   return true;
 }
 
-
-void H5IO::_setCompressionPList()
+/**
+ * @brief Overwrite only the regions marked with markDirty
+ * @details Not done with MPI, where the packed array is only this rank's
+ * block; the whole block is overwritten instead.
+ *
+ * @return true if the write was handled, in which case status is set
+ */
+bool H5IO::_writeDirtyRegions(void *array, std::string key)
 {
-  dset_chunk_plist = H5Pcreate(H5P_DATASET_CREATE);
-  status = H5Pset_layout(dset_chunk_plist, H5D_CHUNKED);
-
-  status = H5Pset_chunk(dset_chunk_plist, dset_dspace.getRank(), dset_dspace.chunk.getPtr());
+  if(_usingMPI())
+    return false;
 
-  if(_checkCompression())
-    status = H5Pset_deflate(dset_chunk_plist, compression_level);
-}
+  int rank = H5Sget_simple_extent_ndims(dset_dspace.id);
+  std::vector<hsize_t> dims(rank);
+  H5Sget_simple_extent_dims(dset_dspace.id, &dims[0], NULL);
 
-bool H5IO::_setAppend()
-{
-  herr_t status;
-  int tmp_rank;
-  H5IO_DEBUG_COUT << "Selecting hyperslab to append to..." << std::endl << std::flush;
+  H5Sselect_none(dset_dspace.id);
+  for(size_t r = 0; r < dirty_start.size(); ++r)
+  {
+    bool fits = ((int) dirty_start[r].size() == rank);
+    for(int i = 0; fits && i < rank; ++i)
+      fits = dirty_count[r][i] > 0 && dirty_start[r][i] + dirty_count[r][i] <= dims[i];
+    if(!fits)
+    {
+      H5IO_VERBOSE_COUT << "Dirty region " << r << " does not fit dataset. Aborting write." << std::endl;
+      status = -1;
+      return true;
+    }
+    H5Sselect_hyperslab(dset_dspace.id, H5S_SELECT_OR, &dirty_start[r][0], NULL, &dirty_count[r][0], NULL);
+  }
 
-  //get id for dspace
-  H5IO_DEBUG_COUT << "  Getting dataspace ID..." << std::flush;
-  dset_dspace.id = H5Dget_space(dset_id);
-  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+  // the packed array has the dataset's dimensions, so select the same regions in it
+  const char *data = _packMemSelection(array);
+  hid_t space = H5Scopy(dset_dspace.id);
 
-  //initialize dspace params
-  H5IO_DEBUG_COUT << "  Getting rank of dataspace..." << std::flush;
-  tmp_rank = H5Sget_simple_extent_ndims(dset_dspace.id);
-  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+  H5IO_DEBUG_COUT << "Writing " << dirty_start.size() << " dirty regions..." << std::flush;
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::write);
+    status = H5Dwrite(dset_id, mem_dspace.type, space, dset_dspace.id, dset_xfer_plist, data);
+  }
+  if(stats.isEnabled())
+    stats.addBytesWritten(H5Sget_select_npoints(space) * H5Tget_size(mem_dspace.type));
+  H5Sclose(space);
+  H5IO_DEBUG_COUT << "Done!" << std::endl;
 
-  dset_dspace.setRank(tmp_rank);
+  // unmarked changes may have been made; hashes can't be trusted any more
+  chunk_hashes->erase(key);
+  return true;
+}
 
-  //get max dims and dims of dsapce
-  H5IO_DEBUG_COUT << "  Getting dataspace parameters..." << std::flush;
-  status = H5Sget_simple_extent_dims(dset_dspace.id, dset_dspace.dims.getPtr(), dset_dspace.maxdims.getPtr());
-  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+/**
+ * @brief Overwrite only the chunks whose data changed since the last write
+ * @details Chunks are hashed and compared with the hashes of the last write
+ * of the dataset by this H5IO. Hashes of the new data are left in
+ * new_hashes for the caller to store once the data is written.
+ *
+ * @return true if the write was handled, in which case status is set
+ */
+bool H5IO::_writeChangedChunks(void *array, std::string key, bool exists)
+{
+  new_hashes.clear();
+  H5ChunkIO layout;
+  if(_usingMPI() || !layout.setupLayout(dset_id)
+      || layout.getTypeSize() != H5Tget_size(mem_dspace.type))
+    return false;
 
-  H5IO_DEBUG_COUT << "  Closing dataspace..." << std::flush;
-  status = dset_dspace.closeSpace();
-  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+  const char *data = _packMemSelection(array);
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::pack);
+    layout.hashChunks(data, new_hashes, thread_pool);
+  }
 
-  H5IO_DEBUG_COUT << "  Formating datspace for next row..." << std::flush;
-  dset_dspace.stride.setValues(1);
-  dset_dspace.block.setValues(1);
-  dset_dspace.start.setValues(0);
+  ChunkHashes::iterator old = chunk_hashes->find(key);
+  if(!exists || old == chunk_hashes->end() || old->second.size() != new_hashes.size())
+    return false;
 
-  //start at end of current last line begining of
-  dset_dspace.start[0] = dset_dspace.dims[0];
+  int rank = H5Sget_simple_extent_ndims(dset_dspace.id);
+  std::vector<hsize_t> dims(rank), offset(rank), extent(rank);
+  H5Sget_simple_extent_dims(dset_dspace.id, &dims[0], NULL);
 
-  //increase dspace dims by 1 (this is so dataset can be extended)
-  dset_dspace.dims[0] += 1;//block[0]; if wanted multi line write?
-  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+  hsize_t changed = 0;
+  H5Sselect_none(dset_dspace.id);
+  for(hsize_t i = 0; i < new_hashes.size(); ++i)
+    if(new_hashes[i] != old->second[i])
+    {
+      layout.getChunkRegion(i, &offset[0], &extent[0]);
+      H5Sselect_hyperslab(dset_dspace.id, H5S_SELECT_OR, &offset[0], NULL, &extent[0], NULL);
+      changed++;
+    }
+  H5IO_DEBUG_COUT << changed << " of " << new_hashes.size() << " chunks changed." << std::endl;
 
-  if(_checkAppend()){
-      H5IO_DEBUG_COUT << "  Extending dataset..." << std::flush;
-      status = H5Dset_extent(dset_id, dset_dspace.dims.getPtr());
-      H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
-  } else {
-      H5IO_VERBOSE_COUT << "Can't extend dataset for an append. Aborting write." << std::endl;
-      return false;
+  status = 0;
+  if(changed > 0)
+  {
+    hid_t space = H5Scopy(dset_dspace.id);
+    {
+      H5IOStats::Timer timer(stats, H5IOStats::write);
+      status = H5Dwrite(dset_id, mem_dspace.type, space, dset_dspace.id, dset_xfer_plist, data);
+    }
+    if(stats.isEnabled())
+      stats.addBytesWritten(H5Sget_select_npoints(space) * H5Tget_size(mem_dspace.type));
+    H5Sclose(space);
   }
 
-  H5IO_DEBUG_COUT << "  Reopening dataspace..." << std::flush;
-  dset_dspace.id = H5Dget_space(dset_id);
-  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
-
-  //seting hyperslab
-  H5IO_DEBUG_COUT << "  Selecting hyperslab for append..." << std::flush;
-  dset_dspace.setHyperslab();
-  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
-
-  H5IO_DEBUG_COUT << "Hyperslab selected!" << std::endl << std::flush;
-
   if(status < 0)
   {
-    H5IO_VERBOSE_COUT << "Could not append; aborting write."
-      << std::endl << std::flush;
+    chunk_hashes->erase(old);
+    new_hashes.clear();
   }
   return true;
 }
 
-void H5IO::_closeFileThings()
-{
-  H5Fclose(file_id);
-  H5Dclose(dset_id);
-}
-
-H5IO::H5IO(int mem_rank_in, H5SizeArray &mem_dims_in, hid_t mem_type_in)
-: mem_dspace(), dset_dspace()
-{
-  _initialize(mem_rank_in, mem_dims_in, mem_type_in);
-}
-
-H5IO::H5IO(int mem_rank_in, hsize_t mem_dim_in, hid_t mem_type_in)
-: mem_dspace(), dset_dspace()
+/**
+ * @brief Write the index of setChunkStats for the array just written to dset_id
+ * @details Uses the statistics gathered by _writeChunksParallel if there
+ * are any, otherwise computes them from the packed memory selection.
+ */
+bool H5IO::_writeChunkStats(void *array, std::string dset_name)
 {
+  if(!chunk_stats_enabled)
+    return true;
+
+  H5ChunkIO layout;
+  bool fused = chunk_stats_fused;
+  chunk_stats_fused = false;
+  if(_usingMPI() || !layout.setupLayout(dset_id)
+      || (!fused && !chunk_stats.setup(mem_dspace.type, layout.getNumChunks(), chunk_stats_bins, chunk_stats_min, chunk_stats_max)))
+  {
+    H5IO_VERBOSE_COUT << "Can't write chunk statistics of '" << dset_name << "': it needs to be chunked, "
+      << "of a native float, double, int32 or int64 type, and written without MPI." << std::endl;
+    return false;
+  }
+  if(!fused)
+  {
+    const char *data = _packMemSelection(array);
+    H5IOStats::Timer timer(stats, H5IOStats::statistics);
+    chunk_stats.compute(layout, data, thread_pool);
+  }
 
-  H5SizeArray mem_dims_in(mem_rank_in);
-  mem_dims_in.setValues(mem_dim_in);
-
-  _initialize(mem_rank_in, mem_dims_in, mem_type_in);
-
-}
+  std::string index_name = H5ChunkStats::getIndexName(dset_name);
+  hsize_t index_dims[2] = {chunk_stats.getNumChunks(), (hsize_t) chunk_stats.getColumns()};
+  hid_t index_id = file.openDataset(index_name);
+  if(index_id >= 0)
+  {
+    hid_t index_space = H5Dget_space(index_id);
+    hsize_t dims[2] = {0, 0};
+    bool same_shape = H5Sget_simple_extent_ndims(index_space) == 2 && H5Sget_simple_extent_dims(index_space, dims, NULL) >= 0
+      && dims[0] == index_dims[0] && dims[1] == index_dims[1];
+    H5Sclose(index_space);
+    if(!overwrite || !same_shape)
+    {
+      H5IO_VERBOSE_COUT << "Can't overwrite chunk statistics '" << index_name << "'." << std::endl;
+      return false;
+    }
+  }
+  else
+  {
+    if(!_createGroups(index_name))
+      return false;
+    hid_t index_space = H5Screate_simple(2, index_dims, NULL);
+    {
+      H5IOStats::Timer timer(stats, H5IOStats::dataset_create);
+      index_id = H5Dcreate(file_id, index_name.c_str(), H5T_NATIVE_DOUBLE, index_space, file.getLinkPList(),
+        H5P_DEFAULT, file.getDatasetAccessPList());
+    }
+    H5Sclose(index_space);
+    if(index_id < 0)
+    {
+      H5IO_VERBOSE_COUT << "Could not create dataset '" << index_name << "'." << std::endl;
+      return false;
+    }
+    file.addDataset(index_name, index_id);
+  }
 
-H5IO::~H5IO()
-{
-  mem_dspace.closeSpace();
-  //do i need to close the classes i created? in particular the arrays?
+  H5IOStats::Timer timer(stats, H5IOStats::write);
+  return chunk_stats.write(index_id);
 }
 
 /**
- * @brief Sets level of verbosity
- * @details Can choose between:
- * H5IO_VERBOSE_OFF 0
- * H5IO_VERBOSE_ON 1
- * H5IO_VERBOSE_DEBUG 2
- *
- * @param verbosity_in verbosity level
+ * @brief Write the levels of setPyramid for the array just written to dset_id
+ * @details Downsamples from the packed memory selection in the memory type;
+ * each level is made from the one before it.
  */
-void H5IO::setVerbosity(int verbosity_in)
+bool H5IO::_writePyramid(void *array, std::string dset_name)
 {
-  verbosity_level = verbosity_in;
-  mem_dspace.setVerbosity(verbosity_level);
-  dset_dspace.setVerbosity(verbosity_level);
+  if(pyramid_levels <= 0)
+    return true;
+
+  std::vector<hsize_t> dims;
+  _getDatasetDims(dims);
+  int rank = dims.size();
+  if(_usingMPI() || !H5Pyramid::supported(mem_dspace.type, pyramid_method, rank))
+  {
+    H5IO_VERBOSE_COUT << "Can't write a pyramid of '" << dset_name << "' with this type, rank or MPI." << std::endl;
+    return false;
+  }
+
+  size_t type_size = H5Tget_size(mem_dspace.type);
+  const char *level_data = _packMemSelection(array);
+  std::vector<char> levels[2];
+  hid_t dcpl = H5Dget_create_plist(dset_id);
+  bool written = true;
+  for(int level = 1; level <= pyramid_levels && written; ++level)
+  {
+    std::vector<hsize_t> level_dims(rank);
+    H5Pyramid::getLevelDims(rank, &dims[0], &level_dims[0]);
+    hsize_t n_elements = 1;
+    for(int i = 0; i < rank; ++i)
+      n_elements *= level_dims[i];
+
+    std::vector<char> &level_buffer = levels[level % 2];
+    level_buffer.resize(n_elements * type_size);
+    {
+      H5IOStats::Timer timer(stats, H5IOStats::downsample);
+      H5Pyramid::downsample(mem_dspace.type, pyramid_method, rank, &dims[0], level_data, &level_buffer[0], thread_pool);
+    }
+    written = _writePyramidLevel(H5Pyramid::getLevelName(dset_name, level), level, level_dims, dcpl, &level_buffer[0]);
+    level_data = &level_buffer[0];
+    dims.swap(level_dims);
+  }
+  H5Pclose(dcpl);
+  return written;
 }
 
 /**
- * @brief Set type of dataset to be written/read in file
- * @details Probably one of these:
- * https://www.hdfgroup.org/HDF5/doc/RM/PredefDTypes.html
+ * @brief Write one level of a pyramid, creating its dataset if needed
  *
- * @param dataset_type_in dataset type
+ * @param dims dimensions of the level
+ * @param dcpl creation property list of the full dataset
+ * @param data the level in the memory type
+ */
+bool H5IO::_writePyramidLevel(std::string level_name, int level, std::vector<hsize_t> &dims, hid_t dcpl, const void *data)
+{
+  hid_t level_id = file.openDataset(level_name);
+  if(level_id >= 0)
+  {
+    hid_t level_space = H5Dget_space(level_id);
+    std::vector<hsize_t> level_dims(H5Sget_simple_extent_ndims(level_space));
+    if(!level_dims.empty())
+      H5Sget_simple_extent_dims(level_space, &level_dims[0], NULL);
+    H5Sclose(level_space);
+    if(!overwrite || level_dims != dims)
+    {
+      H5IO_VERBOSE_COUT << "Can't overwrite pyramid level '" << level_name << "'." << std::endl;
+      return false;
+    }
+  }
+  else
+  {
+    if(!_createGroups(level_name))
+      return false;
+
+    hid_t level_plist = H5Pcopy(dcpl);
+    if(H5Pget_layout(level_plist) == H5D_CHUNKED)
+    {
+      std::vector<hsize_t> level_chunk(dims.size());
+      H5Pget_chunk(level_plist, dims.size(), &level_chunk[0]);
+      for(size_t i = 0; i < dims.size(); ++i)
+        if(level_chunk[i] > dims[i])
+          level_chunk[i] = dims[i];
+      H5Pset_chunk(level_plist, dims.size(), &level_chunk[0]);
+    }
+
+    hid_t level_space = H5Screate_simple(dims.size(), &dims[0], NULL);
+    {
+      H5IOStats::Timer timer(stats, H5IOStats::dataset_create);
+      level_id = H5Dcreate(file_id, level_name.c_str(), dset_dspace.type, level_space, file.getLinkPList(),
+        level_plist, file.getDatasetAccessPList());
+    }
+    H5Sclose(level_space);
+    H5Pclose(level_plist);
+    if(level_id < 0)
+    {
+      H5IO_VERBOSE_COUT << "Could not create dataset '" << level_name << "'." << std::endl;
+      return false;
+    }
+    file.addDataset(level_name, level_id);
+
+    long long scale = 1LL << level;
+    hid_t scalar_space = H5Screate(H5S_SCALAR),
+          scale_id = H5Acreate(level_id, "scale", H5T_NATIVE_LLONG, scalar_space, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(scale_id, H5T_NATIVE_LLONG, &scale);
+    H5Aclose(scale_id);
+    H5Sclose(scalar_space);
+  }
+
+  H5IOStats::Timer timer(stats, H5IOStats::write);
+  return H5Dwrite(level_id, mem_dspace.type, H5S_ALL, H5S_ALL, dset_xfer_plist, data) >= 0;
+}
+
+/**
+ * @brief Write the array as the subfiles of setSubfiles and map them into a
+ * virtual dataset of file_name
+ * @details The library lock is only held around this H5IO's own HDF5
+ * calls, so that the threads writing the subfiles can take it.
+ */
+bool H5IO::_writeSubfiles(void *array, std::string file_name, std::string dset_name)
+{
+  clearDirty();
+  if(_usingMPI())
+  {
+    H5IO_VERBOSE_COUT << "Subfiles are not available with MPI. Aborting write." << std::endl;
+    return false;
+  }
+
+  std::vector<hsize_t> dims;
+  _getDatasetDims(dims);
+  int rank = dims.size(),
+      axis = subfile_axis;
+  if(axis < 0 || axis >= rank)
+  {
+    H5IO_VERBOSE_COUT << "Subfile axis is not a dimension of '" << dset_name << "'. Aborting write." << std::endl;
+    return false;
+  }
+
+  // parts keep at least 2 rows, so that no dimension of a subfile is dropped
+  hsize_t parts = subfiles;
+  if(parts > dims[axis] / 2)
+    parts = dims[axis] / 2;
+  if(parts < 1)
+    parts = 1;
+
+  const char *data = NULL;
+  bool exists = false;
+  {
+    H5IO_LOCK_LIBRARY;
+    if(!_openOrCreateFile(file_name, false))
+      return false;
+
+    exists = _checkDatasetExists(dset_name);
+    if(exists)
+    {
+      hid_t dcpl = H5Dget_create_plist(dset_id);
+      bool is_virtual = H5Pget_layout(dcpl) == H5D_VIRTUAL;
+      H5Pclose(dcpl);
+      bool reuse = overwrite && is_virtual && _checkOverwrite();
+      dset_dspace.closeSpace();
+      // closes the subfiles the virtual dataset has open
+      file.closeDataset(dset_name);
+      if(!reuse)
+      {
+        H5IO_VERBOSE_COUT << "Can't write subfiles of '" << dset_name << "' over the dataset there. Aborting write." << std::endl;
+        return false;
+      }
+    }
+    data = _packMemSelection(array);
+  }
+
+  size_t row_bytes = H5Tget_size(mem_dspace.type);
+  for(int i = 1; i < rank; ++i)
+    row_bytes *= dims[i];
+  int part_threads = thread_pool.getThreads() / parts;
+  std::vector<char> written(parts, 0);
+
+  std::vector<std::thread> writers;
+  for(hsize_t k = 0; k < parts; ++k)
+    writers.push_back(std::thread([&, k]() {
+      hsize_t first = dims[axis] * k / parts,
+              rows = dims[axis] * (k + 1) / parts - first;
+
+      // the first dimension is split by pointing at the part; others by
+      // selecting it in the whole array
+      H5SizeArray part_dims(rank);
+      for(int i = 0; i < rank; ++i)
+        part_dims[i] = dims[i];
+      const char *part_data = data;
+      if(axis == 0)
+      {
+        part_dims[0] = rows;
+        part_data += first * row_bytes;
+      }
+
+      H5IO part_io(rank, part_dims, mem_dspace.type);
+      {
+        H5IO_LOCK_SETTINGS;
+        part_io._copySettings(*this);
+      }
+      part_io.setThreads(part_threads > 1 ? part_threads : 1);
+      part_io.setSubfiles(0, 0);
+      part_io.setPyramid(0, pyramid_method);
+      part_io.setChunkStats(false, 0, 0, 0);
+      part_io.setIncremental(false);
+      part_io.chunk_hashes = std::make_shared<ChunkHashes>();
+      part_io.dset_dspace.type = dset_dspace.type;
+      if(axis != 0)
+      {
+        H5IO_LOCK_LIBRARY;
+        part_io.mem_dspace.start[axis] = first;
+        part_io.mem_dspace.count[axis] = rows;
+        part_io.mem_dspace.selectHyperslab(part_io.mem_dspace.id);
+      }
+
+      written[k] = part_io.writeArrayToFile(const_cast<char *>(part_data), getSubfileName(file_name, k), dset_name, false);
+      part_io.closeFile();
+      if(stats.isEnabled())
+        part_io.getStats(stats);
+    }));
+  for(size_t k = 0; k < writers.size(); ++k)
+    writers[k].join();
+
+  H5IO_LOCK_LIBRARY;
+  for(hsize_t k = 0; k < parts; ++k)
+    if(!written[k])
+    {
+      H5IO_VERBOSE_COUT << "Could not write subfile " << k << " of '" << dset_name << "'." << std::endl;
+      return false;
+    }
+  if(exists)
+  {
+    if(!persistent_file)
+      file.close();
+    return true;
+  }
+
+  if(!_openOrCreateFile(file_name, false) || !_createGroups(dset_name))
+    return false;
+
+  // subfiles are named relative to file_name, which HDF5 looks next to
+  hid_t vspace = H5Screate_simple(rank, &dims[0], NULL),
+        dcpl = H5Pcreate(H5P_DATASET_CREATE);
+  for(hsize_t k = 0; k < parts; ++k)
+  {
+    std::vector<hsize_t> start(rank, 0), count(dims);
+    start[axis] = dims[axis] * k / parts;
+    count[axis] = dims[axis] * (k + 1) / parts - start[axis];
+    H5Sselect_hyperslab(vspace, H5S_SELECT_SET, &start[0], NULL, &count[0], NULL);
+
+    std::string source_name = getSubfileName(file_name, k);
+    source_name = source_name.substr(source_name.rfind('/') + 1);
+    hid_t source_space = H5Screate_simple(rank, &count[0], NULL);
+    H5Pset_virtual(dcpl, vspace, source_name.c_str(), dset_name.c_str(), source_space);
+    H5Sclose(source_space);
+  }
+  H5Sselect_all(vspace);
+
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::dataset_create);
+    dset_id = H5Dcreate(file_id, dset_name.c_str(), dset_dspace.type, vspace, file.getLinkPList(), dcpl,
+      file.getDatasetAccessPList());
+  }
+  H5Pclose(dcpl);
+  H5Sclose(vspace);
+  if(dset_id < 0)
+  {
+    H5IO_VERBOSE_COUT << "Could not create dataset '" << dset_name << "'." << std::endl;
+    return false;
+  }
+  file.addDataset(dset_name, dset_id);
+  if(!persistent_file)
+    file.close();
+  return true;
+}
+
+/**
+ * @brief Set dset_dspace.chunk for a new fixed-size dataset
+ * @details Uses the chunking chosen with setChunkWhole(), setChunkDims() or
+ * setChunkAuto(). Falls back to automatic chunking when explicit chunk
+ * dimensions do not fit the dataset or a whole-dataset chunk would exceed
+ * HDF5's 4 GB chunk limit.
+ */
+void H5IO::_setChunkDims()
+{
+  size_t type_size = H5Tget_size(dset_dspace.type);
+
+  if(chunk_mode == chunk_contiguous)
+    return;
+
+  if(chunk_mode == chunk_manual)
+  {
+    if(chunk_dims.getRank() == dset_dspace.getRank())
+    {
+      for(int i = 0; i < dset_dspace.getRank(); ++i)
+      {
+        dset_dspace.chunk[i] = chunk_dims[i];
+        if(dset_dspace.chunk[i] > dset_dspace.dims[i])
+          dset_dspace.chunk[i] = dset_dspace.dims[i];
+        if(dset_dspace.chunk[i] < 1)
+          dset_dspace.chunk[i] = 1;
+      }
+      if(dset_dspace.getChunkBytes(type_size) <= H5IO_MAX_CHUNK_BYTES)
+        return;
+    }
+    H5IO_VERBOSE_COUT << "Chunk dimensions do not fit dataset; choosing chunk automatically." << std::endl;
+  }
+  else if(chunk_mode == chunk_whole)
+  {
+    dset_dspace.chunk = dset_dspace.dims;
+    if(dset_dspace.getChunkBytes(type_size) <= H5IO_MAX_CHUNK_BYTES)
+      return;
+    H5IO_VERBOSE_COUT << "Dataset too large for a single chunk; choosing chunk automatically." << std::endl;
+  }
+
+  if(chunk_access.getRank() == dset_dspace.getRank())
+    dset_dspace.guessChunk(type_size, chunk_target_bytes, chunk_access);
+  else
+    dset_dspace.guessChunk(type_size, chunk_target_bytes);
+  H5IO_DEBUG_COUT << "Chunk is " << dset_dspace.getChunkBytes(type_size) << " bytes." << std::endl;
+}
+
+bool H5IO::_checkAppend(std::vector<hsize_t> &row_dims)
+{
+  if(dset_dspace.getRank() == 1 + (int) row_dims.size())
+  {
+    if(dset_dspace.maxdims[0] == H5S_UNLIMITED || dset_dspace.dims[0] <= dset_dspace.maxdims[0])
+    {
+      for( int i = 1; i < dset_dspace.getRank(); ++i )
+        if( dset_dspace.dims[i] != row_dims[i-1]) {
+          H5IO_DEBUG_COUT << "Here..." << i << dset_dspace.dims[i] << row_dims[i-1] << std::flush;
+          return false;
+        }
+      return true;
+    }
+  }
+  return false;
+
+}
+
+/**
+ * @brief Check if a dataset exists in the open file
+ * @details If it does, dset_id is set to its (cached) id.
+ */
+bool H5IO::_checkDatasetExists(std::string dset_name)
+{
+  H5IO_DEBUG_COUT << "Seeing if dataset exists..." << std::flush;
+  dset_id = file.openDataset(dset_name);
+
+  if( dset_id < 0 ) {
+    H5IO_DEBUG_COUT << "Dataset does not exist." << std::endl;
+    return false;
+  }
+
+  H5IO_DEBUG_COUT << "Dataset exists!" << std::endl << std::flush;
+  return true;
+}
+
+
+/**
+ * @brief Get compression settings used for a dataset
+ * @details Settings from setDatasetCompression if there are any for
+ * dset_name, otherwise those from setCompression.
+ */
+const H5Compression & H5IO::_getCompression(std::string dset_name)
+{
+  std::map<std::string, H5Compression>::iterator it = dataset_compression.find(dset_name);
+  if(it != dataset_compression.end())
+    return it->second;
+  return compression;
+}
+
+void H5IO::_setCompressionPList(std::string dset_name)
+{
+  dset_chunk_plist = H5Pcreate(H5P_DATASET_CREATE);
+  if(chunk_mode == chunk_contiguous && dset_dspace.maxdims[0] != H5S_UNLIMITED)
+  {
+    status = H5Pset_layout(dset_chunk_plist, H5D_CONTIGUOUS);
+    if(_getCompression(dset_name).getMethod() != H5Compression::none)
+      H5IO_DEBUG_COUT << "Contiguous datasets are not compressed." << std::endl;
+    return;
+  }
+  status = H5Pset_layout(dset_chunk_plist, H5D_CHUNKED);
+
+  status = H5Pset_chunk(dset_chunk_plist, dset_dspace.getRank(), dset_dspace.chunk.getPtr());
+
+  const H5Compression &dset_compression = _getCompression(dset_name);
+  if(dset_compression.apply(dset_chunk_plist, dset_dspace.type) != dset_compression.getMethod())
+    H5IO_VERBOSE_COUT << "Compression method " << dset_compression.getMethod()
+      << " not available; using a fallback." << std::endl;
+}
+
+/**
+ * @brief Extend an append dataset and select the new rows
+ *
+ * @param row_dims dimensions of one row
+ * @param rows number of rows to add
+ */
+bool H5IO::_setAppend(std::vector<hsize_t> &row_dims, hsize_t rows)
+{
+  herr_t status;
+  int tmp_rank;
+  H5IO_DEBUG_COUT << "Selecting hyperslab to append to..." << std::endl << std::flush;
+
+  //get id for dspace
+  H5IO_DEBUG_COUT << "  Getting dataspace ID..." << std::flush;
+  dset_dspace.id = H5Dget_space(dset_id);
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+
+  //initialize dspace params
+  H5IO_DEBUG_COUT << "  Getting rank of dataspace..." << std::flush;
+  tmp_rank = H5Sget_simple_extent_ndims(dset_dspace.id);
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+
+  dset_dspace.setRank(tmp_rank);
+
+  //get max dims and dims of dsapce
+  H5IO_DEBUG_COUT << "  Getting dataspace parameters..." << std::flush;
+  status = H5Sget_simple_extent_dims(dset_dspace.id, dset_dspace.dims.getPtr(), dset_dspace.maxdims.getPtr());
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+
+  H5IO_DEBUG_COUT << "  Closing dataspace..." << std::flush;
+  status = dset_dspace.closeSpace();
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+
+  H5IO_DEBUG_COUT << "  Formating datspace for next row..." << std::flush;
+  dset_dspace.stride.setValues(1);
+  dset_dspace.block.setValues(1);
+  dset_dspace.start.setValues(0);
+
+  //start at end of current last line begining of
+  dset_dspace.start[0] = dset_dspace.dims[0];
+
+  //increase dspace dims by number of rows (this is so dataset can be extended)
+  dset_dspace.dims[0] += rows;
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+
+  if(_checkAppend(row_dims)){
+      H5IO_DEBUG_COUT << "  Extending dataset..." << std::flush;
+      H5IOStats::Timer timer(stats, H5IOStats::extent_change);
+      status = H5Dset_extent(dset_id, dset_dspace.dims.getPtr());
+      H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+  } else {
+      H5IO_VERBOSE_COUT << "Can't extend dataset for an append. Aborting write." << std::endl;
+      return false;
+  }
+
+  H5IO_DEBUG_COUT << "  Reopening dataspace..." << std::flush;
+  dset_dspace.id = H5Dget_space(dset_id);
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+
+  //seting hyperslab
+  H5IO_DEBUG_COUT << "  Selecting hyperslab for append..." << std::flush;
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::hyperslab_select);
+    dset_dspace.setHyperslab();
+  }
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+
+  H5IO_DEBUG_COUT << "Hyperslab selected!" << std::endl << std::flush;
+
+  if(status < 0)
+  {
+    H5IO_VERBOSE_COUT << "Could not append; aborting write."
+      << std::endl << std::flush;
+  }
+  return true;
+}
+
+/**
+ * @brief Buffer the selected memory hyperslab as one row of an append dataset
+ * @details The row is copied, so array may be reused immediately. Buffered
+ * rows are written once append_buffer_rows have accumulated, or when
+ * flushAppendBuffers() is called.
+ */
+bool H5IO::_bufferAppend(void *array, std::string file_name, std::string dset_name)
+{
+  std::vector<hsize_t> row_dims;
+  _getRowDims(row_dims);
+
+  AppendBuffer &buffer = append_buffers[file_name + ":" + dset_name];
+  if(buffer.rows > 0 && buffer.row_dims != row_dims)
+  {
+    H5IO_DEBUG_COUT << "Row shape changed; committing buffered rows..." << std::endl;
+    if(!_commitAppendBuffer(buffer))
+      return false;
+  }
+  buffer.file_name = file_name;
+  buffer.dset_name = dset_name;
+  buffer.row_dims = row_dims;
+
+  hssize_t row_size = H5Sget_select_npoints(mem_dspace.id);
+  size_t row_bytes = row_size * H5Tget_size(mem_dspace.type);
+  size_t offset = buffer.data.size();
+  if(buffer.data.capacity() < offset + row_bytes)
+    buffer.data.reserve(append_buffer_rows * row_bytes);
+  buffer.data.resize(offset + row_bytes);
+
+  H5IO_DEBUG_COUT << "Buffering row " << buffer.rows << " of " << append_buffer_rows << "..." << std::flush;
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::pack);
+    if(H5Pack::gather(mem_dspace, H5Tget_size(mem_dspace.type), array, &buffer.data[offset]))
+      status = 0;
+    else
+      status = H5Dgather(mem_dspace.id, array, mem_dspace.type, row_bytes, &buffer.data[offset], NULL, NULL);
+  }
+  if(status < 0)
+  {
+    buffer.data.resize(offset);
+    return false;
+  }
+  buffer.rows++;
+  H5IO_DEBUG_COUT << "Done!" << std::endl;
+
+  if(buffer.rows >= append_buffer_rows)
+    return _commitAppendBuffer(buffer);
+  return true;
+}
+
+/**
+ * @brief Write all rows held in an append buffer with a single extent
+ * change and a single H5Dwrite, then empty the buffer.
+ */
+bool H5IO::_commitAppendBuffer(AppendBuffer &buffer)
+{
+  if(buffer.rows == 0)
+    return true;
+
+  hsize_t rows = buffer.rows;
+  buffer.rows = 0;
+
+  if(!_openOrCreateFile(buffer.file_name, false))
+  {
+    buffer.data.clear();
+    return false;
+  }
+
+  if( ! _checkDatasetExists(buffer.dset_name) )
+    if( ! _createOpenDatasetAppend(buffer.dset_name, buffer.row_dims) )
+    {
+      buffer.data.clear();
+      return false;
+    }
+
+  if( ! _setAppend(buffer.row_dims, rows) )
+  {
+    buffer.data.clear();
+    return false;
+  }
+
+  H5IO_DEBUG_COUT << "Writing " << rows << " buffered rows..." << std::flush;
+  hsize_t n_elements = buffer.data.size() / H5Tget_size(mem_dspace.type);
+  hid_t buffer_space = H5Screate_simple(1, &n_elements, NULL),
+        buffer_type = mem_dspace.type;
+  const char *data = &buffer.data[0];
+  if(_useConversion(mem_dspace.type, dset_dspace.type))
+  {
+    convert_buffer.resize(n_elements * H5Tget_size(dset_dspace.type));
+    _convert(mem_dspace.type, dset_dspace.type, data, convert_buffer.data(), n_elements);
+    data = convert_buffer.data();
+    buffer_type = dset_dspace.type;
+  }
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::write);
+    status = H5Dwrite(dset_id, buffer_type, buffer_space, dset_dspace.id, dset_xfer_plist, data);
+  }
+  stats.addBytesWritten(buffer.data.size());
+  H5Sclose(buffer_space);
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+
+  buffer.data.clear();
+  _closeFileThings();
+  return status >= 0;
+}
+
+/**
+ * @brief Check if the memory hyperslab selects the whole array
+ */
+bool H5IO::_memSelectionIsAll()
+{
+  hssize_t total = 1;
+  for(int i = 0; i < mem_dspace.getRank(); ++i)
+    total *= mem_dspace.dims[i];
+  return H5Sget_select_npoints(mem_dspace.id) == total;
+}
+
+/**
+ * @brief Get the selected memory hyperslab as a contiguous array
+ * @details Returns array itself if everything is selected, otherwise the
+ * selection is gathered into pack_buffer (by H5Pack when it can, else by
+ * HDF5).
+ */
+const char * H5IO::_packMemSelection(void *array)
+{
+  if(_memSelectionIsAll())
+    return (const char *) array;
+
+  H5IOStats::Timer timer(stats, H5IOStats::pack);
+  size_t bytes = H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(mem_dspace.type);
+  pack_buffer.resize(bytes);
+  if(!H5Pack::gather(mem_dspace, H5Tget_size(mem_dspace.type), array, &pack_buffer[0]))
+    H5Dgather(mem_dspace.id, array, mem_dspace.type, bytes, &pack_buffer[0], NULL, NULL);
+  return &pack_buffer[0];
+}
+
+struct H5IOScatterSource
+{
+  const void *data;
+  size_t bytes;
+};
+
+static herr_t _scatterCallback(const void **src_buf, size_t *src_buf_bytes_used, void *op_data)
+{
+  H5IOScatterSource *source = (H5IOScatterSource *) op_data;
+  *src_buf = source->data;
+  *src_buf_bytes_used = source->bytes;
+  return 0;
+}
+
+/**
+ * @brief Copy a contiguous array into the selected memory hyperslab
+ * @details Inverse of _packMemSelection.
+ */
+void H5IO::_unpackMemSelection(const char *packed, void *array)
+{
+  if(packed == array)
+    return;
+
+  H5IOStats::Timer timer(stats, H5IOStats::pack);
+  if(H5Pack::scatter(mem_dspace, H5Tget_size(mem_dspace.type), packed, array))
+    return;
+
+  H5IOScatterSource source;
+  source.data = packed;
+  source.bytes = H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(mem_dspace.type);
+  H5Dscatter(_scatterCallback, &source, mem_dspace.type, mem_dspace.id, array);
+}
+
+/**
+ * @brief Check if a strided memory selection should be packed before
+ * handing it to HDF5
+ * @details HDF5 walks hyperslab selections element by element; packing
+ * with H5Pack and using a contiguous memory dataspace is much faster.
+ */
+bool H5IO::_usePackedSelection()
+{
+  return !_memSelectionIsAll() && H5Pack::supported(mem_dspace, H5Tget_size(mem_dspace.type));
+}
+
+/**
+ * @brief Check if H5Convert should convert between two types instead of HDF5
+ */
+bool H5IO::_useConversion(hid_t src_type, hid_t dst_type)
+{
+  return H5Tequal(src_type, dst_type) <= 0 && H5Convert::supported(src_type, dst_type);
+}
+
+/**
+ * @brief Convert contiguous elements on the thread pool
+ */
+void H5IO::_convert(hid_t src_type, hid_t dst_type, const void *src, void *dst, hsize_t n_elements)
+{
+  H5IOStats::Timer timer(stats, H5IOStats::conversion);
+  H5Convert::convert(src_type, dst_type, src, dst, n_elements, thread_pool);
+}
+
+/**
+ * @brief Write the memory selection of array to the selection of dset_dspace.id
+ * @details Strided selections are packed first. If the dataset type differs
+ * from the memory type and H5Convert handles the pair, the packed elements
+ * are converted into convert_buffer and written in the dataset type.
+ */
+herr_t H5IO::_writeMemSelection(void *array)
+{
+  hid_t space = mem_dspace.id,
+        type = mem_dspace.type;
+  const void *data = array;
+  bool convert = _useConversion(mem_dspace.type, dset_dspace.type);
+  if(convert || _usePackedSelection())
+  {
+    data = _packMemSelection(array);
+    hsize_t n_elements = H5Sget_select_npoints(mem_dspace.id);
+    space = H5Screate_simple(1, &n_elements, NULL);
+    if(convert)
+    {
+      convert_buffer.resize(n_elements * H5Tget_size(dset_dspace.type));
+      _convert(mem_dspace.type, dset_dspace.type, data, convert_buffer.data(), n_elements);
+      data = convert_buffer.data();
+      type = dset_dspace.type;
+    }
+  }
+
+  herr_t write_status;
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::write);
+    write_status = H5Dwrite(dset_id, type, space, dset_dspace.id, dset_xfer_plist, data);
+  }
+  if(space != mem_dspace.id)
+    H5Sclose(space);
+  return write_status;
+}
+
+/**
+ * @brief Read the selection of dset_dspace.id into the memory selection of array
+ * @details The reverse of _writeMemSelection: datasets stored in a type
+ * H5Convert handles are read in that type into convert_buffer and converted,
+ * and strided selections are unpacked last.
+ */
+herr_t H5IO::_readMemSelection(void *array)
+{
+  hid_t file_type = H5Dget_type(dset_id);
+  bool convert = _useConversion(file_type, mem_dspace.type);
+  if(!convert && !_usePackedSelection())
+  {
+    H5Tclose(file_type);
+    H5IOStats::Timer timer(stats, H5IOStats::read);
+    return H5Dread(dset_id, mem_dspace.type, mem_dspace.id, dset_dspace.id, dset_xfer_plist, array);
+  }
+
+  hsize_t n_elements = H5Sget_select_npoints(mem_dspace.id);
+  hid_t space = H5Screate_simple(1, &n_elements, NULL);
+  char *packed = (char *) array;
+  if(!_memSelectionIsAll())
+  {
+    pack_buffer.resize(n_elements * H5Tget_size(mem_dspace.type));
+    packed = pack_buffer.data();
+  }
+  if(convert)
+    convert_buffer.resize(n_elements * H5Tget_size(file_type));
+
+  herr_t read_status;
+  {
+    H5IOStats::Timer timer(stats, H5IOStats::read);
+    if(convert)
+      read_status = H5Dread(dset_id, file_type, space, dset_dspace.id, dset_xfer_plist, convert_buffer.data());
+    else
+      read_status = H5Dread(dset_id, mem_dspace.type, space, dset_dspace.id, dset_xfer_plist, packed);
+  }
+  if(read_status >= 0 && convert)
+    _convert(file_type, mem_dspace.type, convert_buffer.data(), packed, n_elements);
+  H5Tclose(file_type);
+  H5Sclose(space);
+  if(read_status >= 0 && packed != array)
+    _unpackMemSelection(packed, array);
+  return read_status;
+}
+
+/**
+ * @brief Write a new dataset by compressing its chunks on the thread pool
+ * @details Used when parallel compression is on and the dataset's type and
+ * compression allow it (see H5ChunkIO).
+ *
+ * @return true if the write was handled, in which case status is set
+ */
+bool H5IO::_writeChunksParallel(void *array)
+{
+  H5ChunkIO chunk_io;
+  if(H5Tequal(mem_dspace.type, dset_dspace.type) <= 0 || !chunk_io.setup(dset_id))
+    return false;
+
+  H5IO_DEBUG_COUT << "Writing " << chunk_io.getNumChunks() << " chunks on "
+    << thread_pool.getThreads() << " threads..." << std::flush;
+  const char *data = _packMemSelection(array);
+  chunk_stats_fused = chunk_stats_enabled && chunk_stats.setup(mem_dspace.type, chunk_io.getNumChunks(),
+    chunk_stats_bins, chunk_stats_min, chunk_stats_max);
+  status = (chunk_io.writeChunks(dset_id, data, thread_pool, stats, (chunk_stats_fused ? &chunk_stats : NULL)) ? 0 : -1);
+  if(stats.isEnabled())
+    stats.addBytesWritten(H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(mem_dspace.type));
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+  return true;
+}
+
+/**
+ * @brief Read a whole dataset by decompressing its chunks on the thread pool
+ *
+ * @return true if the read was handled, in which case status is set
+ */
+bool H5IO::_readChunksParallel(void *array)
+{
+  H5ChunkIO chunk_io;
+  hid_t file_type = H5Dget_type(dset_id);
+  bool same_type = H5Tequal(mem_dspace.type, file_type) > 0;
+  H5Tclose(file_type);
+
+  if(!same_type || !chunk_io.setup(dset_id)
+      || H5Sget_select_npoints(mem_dspace.id) != H5Sget_simple_extent_npoints(dset_dspace.id))
+    return false;
+
+  H5IO_DEBUG_COUT << "Reading " << chunk_io.getNumChunks() << " chunks on "
+    << thread_pool.getThreads() << " threads..." << std::flush;
+  char *data = (char *) array;
+  if(!_memSelectionIsAll())
+  {
+    pack_buffer.resize(H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(mem_dspace.type));
+    data = &pack_buffer[0];
+  }
+  status = (chunk_io.readChunks(dset_id, data, thread_pool, stats) ? 0 : -1);
+  if(stats.isEnabled())
+    stats.addBytesRead(H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(mem_dspace.type));
+  if(status >= 0)
+    _unpackMemSelection(data, array);
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+  return true;
+}
+
+/**
+ * @brief Release per-call resources after a read or write
+ * @details The file and its datasets stay open for the next call unless
+ * persistent files have been turned off with setPersistentFile(false).
+ */
+void H5IO::_closeFileThings()
+{
+  dset_dspace.closeSpace();
+  if(!persistent_file)
+    file.close();
+}
+
+H5IO::H5IO(int mem_rank_in, H5SizeArray &mem_dims_in, hid_t mem_type_in)
+: mem_dspace(), dset_dspace(), chunk_dims(0), chunk_access(0), thread_pool(1)
+{
+  _initialize(mem_rank_in, mem_dims_in, mem_type_in);
+}
+
+H5IO::H5IO(int mem_rank_in, hsize_t mem_dim_in, hid_t mem_type_in)
+: mem_dspace(), dset_dspace(), chunk_dims(0), chunk_access(0), thread_pool(1)
+{
+
+  H5SizeArray mem_dims_in(mem_rank_in);
+  mem_dims_in.setValues(mem_dim_in);
+
+  _initialize(mem_rank_in, mem_dims_in, mem_type_in);
+
+}
+
+H5IO::~H5IO()
+{
+  _stopAsyncWriter();
+  closeFile();
+  H5IO_LOCK_LIBRARY;
+  if(dset_xfer_plist != H5P_DEFAULT)
+    H5Pclose(dset_xfer_plist);
+  mem_dspace.closeSpace();
+  //do i need to close the classes i created? in particular the arrays?
+}
+
+/**
+ * @brief Sets level of verbosity
+ * @details Can choose between:
+ * H5IO_VERBOSE_OFF 0
+ * H5IO_VERBOSE_ON 1
+ * H5IO_VERBOSE_DEBUG 2
+ *
+ * @param verbosity_in verbosity level
+ */
+void H5IO::setVerbosity(int verbosity_in)
+{
+  H5IO_LOCK_SETTINGS;
+  verbosity_level = verbosity_in;
+  mem_dspace.setVerbosity(verbosity_level);
+  dset_dspace.setVerbosity(verbosity_level);
+}
+
+/**
+ * @brief Set type of dataset to be written/read in file
+ * @details Probably one of these:
+ * https://www.hdfgroup.org/HDF5/doc/RM/PredefDTypes.html
+ * If it is not the memory type, writes and reads convert. Conversions
+ * between double and float, float and half (H5Convert::createHalfType) and
+ * int64 and int32 run on the thread pool; HDF5 does the rest.
+ *
+ * @param dataset_type_in dataset type
  */
 void H5IO::setDatasetType(hid_t dataset_type_in)
 {
-  dset_dspace.type = dataset_type_in;
+  dset_dspace.type = dataset_type_in;
+}
+
+/**
+ * @brief Refuse to convert between the memory type and file types
+ * @details When on, writes fail unless the dataset type is the memory type,
+ * and reads fail unless the dataset is stored in the memory type, so HDF5's
+ * type conversion is never used. Off by default.
+ *
+ * @param check_in fail on type mismatches
+ */
+void H5IO::setTypeCheck(bool check_in)
+{
+  H5IO_LOCK_SETTINGS;
+  type_check = check_in;
+}
+
+/**
+ * @brief Check that file_type may be used with the memory type
+ */
+bool H5IO::_checkTypes(hid_t file_type)
+{
+  if(!type_check || H5Tequal(file_type, mem_dspace.type) > 0)
+    return true;
+  H5IO_VERBOSE_COUT << "Dataset type is not the memory type and type conversion is off." << std::endl;
+  return false;
+}
+
+/**
+ * @brief Choose whether the file stays open between calls
+ * @details When on (the default) the file and every dataset used are kept
+ * open across calls to writeArrayToFile and readArrayFromFile until a
+ * different file is used, closeFile() is called, or the H5IO is destroyed.
+ * When off the file is opened and closed on every call.
+ *
+ * @param persistent_in keep file open between calls
+ */
+void H5IO::setPersistentFile(bool persistent_in)
+{
+  {
+    H5IO_LOCK_SETTINGS;
+    persistent_file = persistent_in;
+  }
+  if(!persistent_file)
+    closeFile();
+}
+
+/**
+ * @brief Set cache, alignment and file format settings
+ * @details See H5Access for what can be set and for presets, eg.
+ * setAccess(H5Access(H5Access::throughput)). Closes the open file, so the
+ * settings apply from the next read or write on.
+ *
+ * @param access_in file and dataset access settings
+ */
+void H5IO::setAccess(const H5Access &access_in)
+{
+  closeFile();
+  {
+    H5IO_LOCK_SETTINGS;
+    access = access_in;
+  }
+  _setAccessPLists();
+}
+
+/**
+ * @brief Open a file image (the bytes of an HDF5 file) as file_name
+ * @details The image is copied and opened in memory, without a backing
+ * store; reads and writes to file_name use it until the file is closed or
+ * another file is used. getFileImage returns the changed bytes. Needs
+ * persistent files (the default); not available with MPI.
+ *
+ * @param image bytes of an HDF5 file, eg. from getFileImage
+ * @param bytes size of image
+ * @param file_name name the image is used under
+ */
+bool H5IO::openFileImage(const void *image, size_t bytes, std::string file_name)
+{
+  if(_usingMPI() || !persistent_file)
+  {
+    H5IO_VERBOSE_COUT << "File images need persistent files and no MPI." << std::endl;
+    return false;
+  }
+  closeFile();
+
+  H5IO_LOCK_LIBRARY;
+  hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+  access.applyFileAccess(fapl);
+  H5Pset_fapl_core(fapl, 1 << 20, false);
+  H5Pset_file_image(fapl, const_cast<void *>(image), bytes);
+  file.setAccessPList(fapl);
+  H5Pclose(fapl);
+
+  bool opened = file.open(file_name, true);
+  _setAccessPLists();
+  if(!opened)
+    H5IO_VERBOSE_COUT << "Could not open file image." << std::endl;
+  return opened;
+}
+
+/**
+ * @brief Get the bytes of the open file
+ * @details Meant for files kept in memory (H5Access::setInMemory and
+ * openFileImage), eg. to send them elsewhere; the image can be opened
+ * again with openFileImage or written to disk as is.
+ *
+ * @param image_out resized to and filled with the file's bytes
+ * @return false if no file is open
+ */
+bool H5IO::getFileImage(std::vector<char> &image_out)
+{
+  waitForAsyncWrites();
+  flushAppendBuffers();
+  H5IO_LOCK_LIBRARY;
+  if(!file.isOpen() || file.flush() < 0)
+    return false;
+
+  ssize_t bytes = H5Fget_file_image(file.getId(), NULL, 0);
+  if(bytes < 0)
+    return false;
+  image_out.resize(bytes);
+  return H5Fget_file_image(file.getId(), image_out.data(), bytes) == bytes;
+}
+
+/**
+ * @brief Check if asynchronous writes must be done synchronously
+ * @details With MPI every rank must make the same calls in order; files in
+ * memory can't be shared with the I/O thread's own file handle.
+ */
+bool H5IO::_writeSynchronously()
+{
+  H5IO_LOCK_LIBRARY;
+  if(_usingMPI() || access.isInMemory())
+    return true;
+  if(!file.isOpen())
+    return false;
+  hid_t fapl = H5Fget_access_plist(file.getId());
+  bool core = H5Pget_driver(fapl) == H5FD_CORE;
+  H5Pclose(fapl);
+  return core;
+}
+
+/**
+ * @brief Give the file the access property lists for the current settings
+ */
+void H5IO::_setAccessPLists()
+{
+  H5IO_LOCK_LIBRARY;
+  hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+  access.applyFileAccess(fapl);
+#ifdef H5IO_MPI
+  if(mpi_enabled)
+  {
+    if(access.isInMemory())
+      H5IO_VERBOSE_COUT << "In-memory files are not available with MPI." << std::endl;
+    H5Pset_fapl_mpio(fapl, mpi_comm, MPI_INFO_NULL);
+  }
+#endif
+  file.setAccessPList(fapl);
+  H5Pclose(fapl);
+
+  hid_t dapl = H5Pcreate(H5P_DATASET_ACCESS);
+  access.applyDatasetAccess(dapl);
+  file.setDatasetAccessPList(dapl);
+  H5Pclose(dapl);
+}
+
+/**
+ * @brief Set number of rows collected before an append is written
+ * @details With rows_in > 1, calls to writeArrayToFile with append_flag set
+ * copy the selected data into a buffer instead of writing it. Once rows_in
+ * rows have accumulated for a dataset they are written with one extent
+ * change and one H5Dwrite. Remaining rows are written by
+ * flushAppendBuffers(), flushFile(), closeFile() or the destructor.
+ *
+ * @param rows_in rows per commit (1 writes every row immediately)
+ */
+void H5IO::setAppendBufferRows(hsize_t rows_in)
+{
+  flushAppendBuffers();
+  H5IO_LOCK_SETTINGS;
+  append_buffer_rows = (rows_in > 0 ? rows_in : 1);
+}
+
+/**
+ * @brief Set number of rows per chunk for newly created append datasets
+ *
+ * @param rows_in rows per chunk (0 uses the append buffer size)
+ */
+void H5IO::setAppendChunkRows(hsize_t rows_in)
+{
+  H5IO_LOCK_SETTINGS;
+  append_chunk_rows = rows_in;
+}
+
+/**
+ * @brief Store each new dataset as a single chunk (the default)
+ * @details Datasets too large for one chunk are chunked automatically.
+ */
+void H5IO::setChunkWhole()
+{
+  H5IO_LOCK_SETTINGS;
+  chunk_mode = chunk_whole;
+}
+
+/**
+ * @brief Store new fixed-size datasets contiguously, without compression
+ * @details Such datasets can be mapped with mapArrayFromFile. Appended
+ * datasets are still chunked.
+ */
+void H5IO::setContiguous()
+{
+  H5IO_LOCK_SETTINGS;
+  chunk_mode = chunk_contiguous;
+}
+
+/**
+ * @brief Allow writeArrayToFile to write into existing datasets
+ * @details Off by default, in which case writing to an existing dataset
+ * fails. When on, an existing dataset is overwritten if it has the
+ * dimensions and type writeArrayToFile would create it with.
+ *
+ * @param overwrite_in overwrite existing datasets
+ */
+void H5IO::setOverwrite(bool overwrite_in)
+{
+  H5IO_LOCK_SETTINGS;
+  overwrite = overwrite_in;
+}
+
+/**
+ * @brief Only rewrite chunks that changed when overwriting datasets
+ * @details Every write of a chunked dataset hashes its chunks. When the
+ * dataset is overwritten, only chunks whose hash differs from the last
+ * write by this H5IO are written. Only writes through this H5IO (and its
+ * asynchronous writes) are tracked; call clearChunkHashes if datasets are
+ * changed by other means. Turning this on also turns on overwriting.
+ *
+ * @param incremental_in rewrite changed chunks only
+ */
+void H5IO::setIncremental(bool incremental_in)
+{
+  H5IO_LOCK_SETTINGS;
+  incremental = incremental_in;
+  if(incremental)
+    overwrite = true;
+}
+
+/**
+ * @brief Write coarser levels of detail along with each whole array
+ * @details Each writeArrayToFile (but not appends) of a dataset "name"
+ * also writes levels_in datasets "name_pyramid/x2", "name_pyramid/x4"...,
+ * each downsampled by 2 in every dimension from the one before it on the
+ * thread pool (see H5Pyramid), so quick looks can read megabytes instead
+ * of the full array. Levels are stored with the dataset's type, chunking
+ * (shrunk to fit) and compression, and have an integer "scale" attribute.
+ * Not available with MPI.
+ *
+ * @param levels_in number of levels; 0 for none
+ * @param method_in H5Pyramid::mean or H5Pyramid::decimate
+ */
+void H5IO::setPyramid(int levels_in, int method_in)
+{
+  H5IO_LOCK_SETTINGS;
+  pyramid_levels = levels_in;
+  pyramid_method = method_in;
+}
+
+/**
+ * @brief Write an index of per-chunk statistics along with each whole array
+ * @details Each writeArrayToFile (but not appends) of a chunked dataset
+ * "name" also writes "name_chunkstats", holding the minimum, maximum, sum
+ * and (with bins_in > 0) a histogram of each chunk (see H5ChunkStats).
+ * With parallel compression they are gathered from each chunk while it is
+ * compressed; otherwise in one pass over the array on the thread pool.
+ * readArrayWhere uses the index to skip chunks. Not available with MPI.
+ *
+ * @param enabled_in write the index
+ * @param bins_in histogram bins; 0 for none
+ * @param hist_min_in lower edge of the first bin
+ * @param hist_max_in upper edge of the last bin
+ */
+void H5IO::setChunkStats(bool enabled_in, int bins_in, double hist_min_in, double hist_max_in)
+{
+  H5IO_LOCK_SETTINGS;
+  chunk_stats_enabled = enabled_in;
+  chunk_stats_bins = bins_in;
+  chunk_stats_min = hist_min_in;
+  chunk_stats_max = hist_max_in;
+}
+
+/**
+ * @brief Write whole arrays as subfiles joined by a virtual dataset
+ * @details Each writeArrayToFile (but not appends) of a dataset "name" to
+ * "file.h5" splits the array along dimension axis_in of the dataset into
+ * subfiles_in parts of nearly equal size (fewer if the dimension is short).
+ * Part k is written to "name" in "file_sub<k>.h5" (see getSubfileName) on
+ * its own thread by its own H5IO, which takes the settings of this one and
+ * a share of its threads. "file.h5" gets a virtual dataset "name" that maps
+ * the parts into one array, so readArrayFromFile of "file.h5" reads the
+ * whole array; the subfiles have to stay next to it.
+ *
+ * Each subfile has its own metadata and I/O, but HDF5 still runs one call
+ * at a time within a process, so the writes overlap in the work done
+ * outside HDF5 (eg. parallel compression, see setParallelCompression).
+ * Pyramids and chunk statistics are not written. With setOverwrite, an
+ * existing virtual dataset of the same shape and type is rewritten through
+ * its subfiles. Not available with MPI.
+ *
+ * @param subfiles_in number of subfiles; 0 or 1 to write single files
+ * @param axis_in dimension to split along
+ */
+void H5IO::setSubfiles(int subfiles_in, int axis_in)
+{
+  H5IO_LOCK_SETTINGS;
+  subfiles = subfiles_in;
+  subfile_axis = axis_in;
+}
+
+/**
+ * @brief Get the name of a subfile of setSubfiles
+ * @details "file.h5" gives "file_sub0.h5", "file_sub1.h5"...; "_sub0"...
+ * is appended to names without the .h5 extension.
+ */
+std::string H5IO::getSubfileName(std::string file_name, int subfile)
+{
+  std::string extension = ".h5",
+              suffix = "_sub" + std::to_string(subfile);
+  size_t stem = file_name.size() - extension.size();
+  if(file_name.size() > extension.size() && file_name.compare(stem, extension.size(), extension) == 0)
+    return file_name.substr(0, stem) + suffix + extension;
+  return file_name + suffix;
+}
+
+/**
+ * @brief Mark a region of the next overwritten dataset as changed
+ * @details The next writeArrayToFile that overwrites an existing dataset
+ * writes only the marked regions and then forgets them. Regions are in
+ * dataset coordinates, so they have the rank of the dataset (see
+ * writeArrayToFile). Ignored when the dataset does not exist yet, and
+ * with MPI, where each rank overwrites its whole block.
+ *
+ * @param start_in first element of the region
+ * @param count_in extent of the region
+ */
+void H5IO::markDirty(H5SizeArray &start_in, H5SizeArray &count_in)
+{
+  std::vector<hsize_t> start(start_in.getPtr(), start_in.getPtr() + start_in.getRank()),
+                       count(count_in.getPtr(), count_in.getPtr() + count_in.getRank());
+  if(start.size() != count.size())
+  {
+    H5IO_VERBOSE_COUT << "Dirty region start and count differ in rank; ignoring." << std::endl;
+    return;
+  }
+  dirty_start.push_back(start);
+  dirty_count.push_back(count);
+}
+
+/**
+ * @brief Forget regions marked with markDirty
+ */
+void H5IO::clearDirty()
+{
+  dirty_start.clear();
+  dirty_count.clear();
+}
+
+/**
+ * @brief Forget chunk hashes of earlier writes
+ * @details The next overwrite of each dataset writes all of it.
+ */
+void H5IO::clearChunkHashes()
+{
+  waitForAsyncWrites();
+  chunk_hashes->clear();
+}
+
+/**
+ * @brief Set chunk dimensions used for new datasets
+ * @details chunk_in must have the rank of the dataset in the file, which
+ * drops memory dimensions of extent 1 (see writeArrayToFile). If it does
+ * not, chunks are chosen automatically.
+ *
+ * @param chunk_in chunk dimensions
+ */
+void H5IO::setChunkDims(H5SizeArray &chunk_in)
+{
+  H5IO_LOCK_SETTINGS;
+  chunk_mode = chunk_manual;
+  chunk_dims.setRank(chunk_in.getRank());
+  chunk_dims = chunk_in;
+}
+
+/**
+ * @brief Choose chunk dimensions of new datasets automatically
+ *
+ * @param target_bytes_in largest wanted chunk size in bytes
+ */
+void H5IO::setChunkAuto(size_t target_bytes_in)
+{
+  H5IO_LOCK_SETTINGS;
+  chunk_mode = chunk_auto;
+  chunk_target_bytes = target_bytes_in;
+  chunk_access.setRank(0);
+}
+
+/**
+ * @brief Choose chunk dimensions of new datasets automatically, aligned with
+ * the hyperslabs they will be accessed with
+ * @details See H5SParams::guessChunk. access_in must have the rank of the
+ * dataset in the file.
+ *
+ * @param target_bytes_in largest wanted chunk size in bytes
+ * @param access_in extent of a typical hyperslab (0 for unrestricted)
+ */
+void H5IO::setChunkAuto(size_t target_bytes_in, H5SizeArray &access_in)
+{
+  H5IO_LOCK_SETTINGS;
+  chunk_mode = chunk_auto;
+  chunk_target_bytes = target_bytes_in;
+  chunk_access.setRank(access_in.getRank());
+  chunk_access = access_in;
+}
+
+/**
+ * @brief Set number of threads H5IO may use
+ * @details Used by parallel compression and type conversion. Threads other
+ * than the caller's never call HDF5.
+ *
+ * @param threads_in number of threads (0 for one per core)
+ */
+void H5IO::setThreads(int threads_in)
+{
+  H5IO_LOCK_SETTINGS;
+  thread_pool.setThreads(threads_in);
+}
+
+/**
+ * @brief Compress and decompress chunks concurrently
+ * @details When on, new datasets (not appends) are written by compressing
+ * their chunks on the thread pool (see setThreads) and storing them with
+ * H5Dwrite_chunk, and whole datasets are read with H5Dread_chunk and
+ * decompressed on the pool. The files are the same as those written
+ * through HDF5's filter pipeline. This only applies when the memory and
+ * dataset types match and compression is deflate or shuffle_deflate;
+ * other writes and reads go through H5Dwrite/H5Dread as usual. Choose
+ * chunks smaller than the dataset (setChunkAuto) to have work to share.
+ *
+ * @param parallel_in use parallel compression
+ */
+void H5IO::setParallelCompression(bool parallel_in)
+{
+  H5IO_LOCK_SETTINGS;
+  parallel_compression = parallel_in;
+}
+
+#ifdef H5IO_MPI
+/**
+ * @brief Write and read one shared dataset from all ranks of comm_in
+ * @details Files are opened with the MPI-IO driver on comm_in, so every
+ * rank must make the same sequence of writeArrayToFile/readArrayFromFile
+ * calls. Each rank's selected memory hyperslab is its local block, which
+ * lands at offset_in in a dataset of dimensions global_dims_in (both of
+ * the memory rank; dimensions are not dropped as they are for serial
+ * writes). Data is transferred with collective H5Dwrite/H5Dread. Appending
+ * and parallel compression are not available in this mode, and
+ * writeArrayToFileAsync writes synchronously.
+ *
+ * @param comm_in communicator of the ranks sharing the file
+ * @param global_dims_in dimensions of the whole dataset
+ * @param offset_in position of this rank's block in the dataset
+ */
+void H5IO::setMPI(MPI_Comm comm_in, H5SizeArray &global_dims_in, H5SizeArray &offset_in)
+{
+  closeFile();
+
+  mpi_enabled = true;
+  mpi_comm = comm_in;
+  mpi_global_dims.resize(mem_dspace.getRank());
+  mpi_offset.resize(mem_dspace.getRank());
+  for(int i = 0; i < mem_dspace.getRank(); ++i)
+  {
+    mpi_global_dims[i] = global_dims_in[i];
+    mpi_offset[i] = offset_in[i];
+  }
+
+  _setAccessPLists();
+
+  H5IO_LOCK_LIBRARY;
+  if(dset_xfer_plist != H5P_DEFAULT)
+    H5Pclose(dset_xfer_plist);
+  dset_xfer_plist = H5Pcreate(H5P_DATASET_XFER);
+  H5Pset_dxpl_mpio(dset_xfer_plist, H5FD_MPIO_COLLECTIVE);
+}
+#endif
+
+bool H5IO::_usingMPI()
+{
+#ifdef H5IO_MPI
+  return mpi_enabled;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Set compression used for new datasets
+ * @details Defaults to deflate at level 9. See H5Compression.
+ *
+ * @param compression_in compression settings
+ */
+void H5IO::setCompression(const H5Compression &compression_in)
+{
+  H5IO_LOCK_SETTINGS;
+  compression = compression_in;
+}
+
+/**
+ * @brief Set compression used for new datasets
+ *
+ * @param method_in one of H5Compression::method
+ * @param level_in method dependent level, see H5Compression
+ */
+void H5IO::setCompression(int method_in, int level_in)
+{
+  H5IO_LOCK_SETTINGS;
+  compression = H5Compression(method_in, level_in);
+}
+
+/**
+ * @brief Set compression for one dataset, overriding setCompression
+ *
+ * @param dset_name path of dataset as passed to writeArrayToFile
+ * @param compression_in compression settings
+ */
+void H5IO::setDatasetCompression(std::string dset_name, const H5Compression &compression_in)
+{
+  H5IO_LOCK_SETTINGS;
+  dataset_compression[dset_name] = compression_in;
+}
+
+/**
+ * @brief Write all buffered append rows to their datasets
+ */
+bool H5IO::flushAppendBuffers()
+{
+  waitForAsyncWrites();
+  H5IO_LOCK_LIBRARY;
+  bool success = true;
+  std::map<std::string, AppendBuffer>::iterator it;
+  for(it = append_buffers.begin(); it != append_buffers.end(); ++it)
+    if(!_commitAppendBuffer(it->second))
+      success = false;
+  append_buffers.clear();
+  return success;
+}
+
+/**
+ * @brief Flush the open file (if any) to disk
+ */
+bool H5IO::flushFile()
+{
+  bool success = flushAppendBuffers();
+  if(async_io)
+    success = async_io->flushFile() && success;
+  H5IO_LOCK_LIBRARY;
+  return file.flush() >= 0 && success;
+}
+
+/**
+ * @brief Close the open file (if any) and all of its datasets
+ */
+void H5IO::closeFile()
+{
+  flushAppendBuffers();
+  if(async_io)
+    async_io->closeFile();
+  H5IO_LOCK_LIBRARY;
+  file.close();
+}
+
+/**
+ * @brief Select part of a dataset to read
+ * @details Mirrors setMemHyperslab for the file side of readArrayFromFile:
+ * reads only the hyperslab (start, stride, count, block) of the dataset,
+ * eg. one z-slice or a subcube of a large grid. All arrays must have the
+ * rank of the dataset in the file, and the hyperslab must contain as many
+ * elements as the selected memory hyperslab. Stays in effect until
+ * clearFileHyperslab is called.
+ *
+ * @param start_in first element
+ * @param stride_in distance between blocks
+ * @param count_in number of blocks
+ * @param block_in size of each block
+ */
+void H5IO::setFileHyperslab(H5SizeArray &start_in, H5SizeArray &stride_in, H5SizeArray &count_in, H5SizeArray &block_in)
+{
+  int rank = start_in.getRank();
+  if(stride_in.getRank() != rank || count_in.getRank() != rank || block_in.getRank() != rank)
+  {
+    H5IO_VERBOSE_COUT << "File hyperslab arrays differ in rank; ignoring." << std::endl;
+    return;
+  }
+  file_slab.setRank(rank);
+  file_slab.start = start_in;
+  file_slab.stride = stride_in;
+  file_slab.count = count_in;
+  file_slab.block = block_in;
+  file_slab_set = true;
+}
+
+/**
+ * @brief Select a contiguous box of a dataset to read
+ * @details Same as setFileHyperslab with unit stride and block.
+ *
+ * @param start_in first element
+ * @param count_in number of elements in each dimension
+ */
+void H5IO::setFileHyperslab(H5SizeArray &start_in, H5SizeArray &count_in)
+{
+  H5SizeArray ones(start_in.getRank());
+  ones.setValues(1);
+  setFileHyperslab(start_in, ones, count_in, ones);
+}
+
+/**
+ * @brief Read whole datasets again
+ */
+void H5IO::clearFileHyperslab()
+{
+  file_slab_set = false;
+}
+
+void H5IO::setMemHyperslab(H5SizeArray &start_in, H5SizeArray &stride_in)
+{
+  H5IO_LOCK_LIBRARY;
+  mem_dspace.start = start_in;
+  mem_dspace.stride = stride_in;
+
+  mem_dspace.setHyperslab();
+}
+
+void H5IO::setMemHyperslab1D(int print_dim, H5SizeArray &start_in, hsize_t stride_in)
+{
+  H5IO_LOCK_LIBRARY;
+  mem_dspace.start = start_in;
+  //set stride too large so that count will be 1
+  mem_dspace.stride = mem_dspace.dims;
+  //fix stride in print dim to be reasonable
+  mem_dspace.stride[print_dim] = stride_in;
+
+  mem_dspace.setHyperslab();
+}
+
+void H5IO::setMemHyperslabNm1D(int drop_dim, H5SizeArray &start_in, H5SizeArray &stride_in)
+{
+  H5IO_LOCK_LIBRARY;
+  mem_dspace.start = start_in;
+  mem_dspace.stride = stride_in;
+
+  //ensure stride in drop dim is too large so count will be 1
+  mem_dspace.stride[drop_dim] = mem_dspace.dims[drop_dim];
+
+  mem_dspace.setHyperslab();
+}
+
+bool H5IO::readArrayFromFile(void *array, std::string file_name, std::string dset_name)
+{
+  return _readArrayFromFile(array, file_name, dset_name, 0, 0);
+}
+
+/**
+ * @brief Read a range of rows (along the first dimension) of a dataset,
+ * eg. of a table-like dataset written with appends
+ * @details Ignores any hyperslab set with setFileHyperslab. The selected
+ * memory hyperslab must have as many elements as the rows read.
+ *
+ * @param array array to read into
+ * @param file_name name of file
+ * @param dset_name path to dataset
+ * @param first_row first row to read
+ * @param num_rows number of rows to read
+ */
+bool H5IO::readRowsFromFile(void *array, std::string file_name, std::string dset_name, hsize_t first_row, hsize_t num_rows)
+{
+  if(num_rows == 0)
+  {
+    H5IO_VERBOSE_COUT << "No rows to read: aborting read." << std::endl;
+    return false;
+  }
+  return _readArrayFromFile(array, file_name, dset_name, first_row, num_rows);
+}
+
+/**
+ * @brief Turn counting and timing of I/O phases on or off
+ * @details Off by default. Records how often and how long files are
+ * opened, groups and datasets are created, append datasets are extended,
+ * hyperslabs are selected, memory selections are packed, chunks are
+ * compressed on the thread pool and data is written and read, as well as
+ * the bytes written and read. Compression done by HDF5's own filters is
+ * part of the write and read times.
+ */
+void H5IO::setStats(bool enabled_in)
+{
+  H5IO_LOCK_SETTINGS;
+  stats.setEnabled(enabled_in);
+}
+
+/**
+ * @brief Get counts recorded since the last resetStats, including those of
+ * asynchronous writes
+ *
+ * @param stats_out counts are added to these
+ */
+void H5IO::getStats(H5IOStats &stats_out)
+{
+  stats_out.accumulate(stats);
+  if(async_io)
+    stats_out.accumulate(async_io->stats);
+}
+
+/**
+ * @brief Get counts recorded since the last resetStats as JSON
+ * @details See H5IOStats::toJSON.
+ */
+std::string H5IO::getStatsJSON()
+{
+  H5IOStats total;
+  getStats(total);
+  return total.toJSON();
+}
+
+/**
+ * @brief Zero all counts
+ */
+void H5IO::resetStats()
+{
+  stats.reset();
+  if(async_io)
+    async_io->stats.reset();
+}
+
+/**
+ * @brief Get a read-only view of a whole dataset without copying it
+ * @details If the dataset is stored contiguously in its native type in a
+ * file opened with the default (sec2) driver, the view maps the dataset's
+ * bytes straight from the file and data is paged in as it is touched.
+ * Otherwise (chunked, filtered, not yet written, non-native types...) the
+ * dataset is read into a buffer held by the view. Memory hyperslabs and the
+ * memory type of this H5IO are not used: the view always has the
+ * dimensions of the dataset and its native type.
+ *
+ * @param view view to fill; anything it held before is released
+ * @param file_name name of file
+ * @param dset_name path to dataset
+ *
+ * @return true on success
+ */
+bool H5IO::mapArrayFromFile(H5MappedArray &view, std::string file_name, std::string dset_name)
+{
+  view.release();
+  waitForAsyncWrites();
+  flushAppendBuffers();
+  H5IO_LOCK_LIBRARY;
+
+  if(!_openOrCreateFile(file_name, true))
+    return false;
+
+  if(!_checkDatasetExists(dset_name))
+  {
+    H5IO_DEBUG_COUT << "Can't map dataset that does not exist." << std::endl;
+    _closeFileThings();
+    return false;
+  }
+
+  dset_dspace.id = H5Dget_space(dset_id);
+  hid_t file_type = H5Dget_type(dset_id);
+  if(H5Tdetect_class(file_type, H5T_VLEN) > 0 || H5Tis_variable_str(file_type) > 0)
+  {
+    H5IO_VERBOSE_COUT << "Can't map variable length data." << std::endl;
+    H5Tclose(file_type);
+    _closeFileThings();
+    return false;
+  }
+  hid_t native_type = H5Tget_native_type(file_type, H5T_DIR_ASCEND);
+  bool native = H5Tequal(file_type, native_type) > 0;
+  H5Tclose(file_type);
+
+  std::vector<hsize_t> dims(H5Sget_simple_extent_ndims(dset_dspace.id));
+  if(!dims.empty())
+    H5Sget_simple_extent_dims(dset_dspace.id, &dims[0], NULL);
+  size_t bytes = H5Sget_simple_extent_npoints(dset_dspace.id) * H5Tget_size(native_type);
+  view.setShape(dims, native_type);
+
+  // mapping needs the dataset's bytes at a known offset of the file itself
+  hid_t dcpl = H5Dget_create_plist(dset_id);
+  bool contiguous = H5Pget_layout(dcpl) == H5D_CONTIGUOUS;
+  H5Pclose(dcpl);
+
+  hid_t fapl = H5Fget_access_plist(file_id);
+  bool sec2 = H5Pget_driver(fapl) == H5FD_SEC2;
+  H5Pclose(fapl);
+
+  hid_t fcpl = H5Fget_create_plist(file_id);
+  hsize_t userblock = 0;
+  H5Pget_userblock(fcpl, &userblock);
+  H5Pclose(fcpl);
+
+  haddr_t offset = HADDR_UNDEF;
+  if(native && contiguous && sec2 && userblock == 0)
+  {
+    offset = H5Dget_offset(dset_id);
+    // make sure data written through the open file is on disk
+    if(offset != HADDR_UNDEF)
+      file.flush();
+  }
+
+  if(offset != HADDR_UNDEF && view.map(file_name, offset, bytes))
+  {
+    H5IO_DEBUG_COUT << "Mapped " << bytes << " bytes at offset " << offset << "." << std::endl;
+    status = 0;
+  }
+  else
+  {
+    H5IO_DEBUG_COUT << "Can't map dataset; reading it..." << std::flush;
+    void *data = view.allocate(bytes);
+    H5IOStats::Timer timer(stats, H5IOStats::read);
+    status = (bytes > 0 ? H5Dread(dset_id, native_type, H5S_ALL, H5S_ALL, dset_xfer_plist, data) : 0);
+    stats.addBytesRead(bytes);
+    H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+  }
+
+  _closeFileThings();
+  if(status < 0)
+    view.release();
+  return status >= 0;
+}
+
+/**
+ * @brief Select what to read in dset_dspace.id
+ * @details Selects rows [first_row, first_row + num_rows) if num_rows > 0,
+ * otherwise the hyperslab from setFileHyperslab if one is set, otherwise
+ * the whole dataset.
+ */
+bool H5IO::_selectFileHyperslab(hsize_t first_row, hsize_t num_rows)
+{
+  H5IOStats::Timer timer(stats, H5IOStats::hyperslab_select);
+  int rank = H5Sget_simple_extent_ndims(dset_dspace.id);
+#ifdef H5IO_MPI
+  if(mpi_enabled)
+  {
+    if(rank != mem_dspace.getRank())
+    {
+      H5IO_VERBOSE_COUT << "Dataset rank does not match memory rank; aborting MPI read." << std::endl;
+      return false;
+    }
+    _selectMPIBlock();
+    return true;
+  }
+#endif
+
+  if(num_rows > 0)
+  {
+    std::vector<hsize_t> start(rank, 0), count(rank);
+    H5Sget_simple_extent_dims(dset_dspace.id, &count[0], NULL);
+    if(first_row + num_rows > count[0])
+    {
+      H5IO_VERBOSE_COUT << "Dataset has only " << count[0] << " rows; aborting read." << std::endl;
+      return false;
+    }
+    start[0] = first_row;
+    count[0] = num_rows;
+    return H5Sselect_hyperslab(dset_dspace.id, H5S_SELECT_SET, &start[0], NULL, &count[0], NULL) >= 0;
+  }
+
+  if(file_slab_set)
+  {
+    if(file_slab.getRank() != rank)
+    {
+      H5IO_VERBOSE_COUT << "File hyperslab rank does not match dataset rank; aborting read." << std::endl;
+      return false;
+    }
+    return file_slab.selectHyperslab(dset_dspace.id) >= 0;
+  }
+  return true;
+}
+
+bool H5IO::_readArrayFromFile(void *array, std::string file_name, std::string dset_name, hsize_t first_row, hsize_t num_rows)
+{
+  waitForAsyncWrites();
+  flushAppendBuffers();
+  H5IO_LOCK_LIBRARY;
+
+  if(!_openOrCreateFile(file_name, true))
+    return false;
+
+  if(!_checkDatasetExists(dset_name))
+  {
+    H5IO_DEBUG_COUT << "Can't read dataset that does not exist. Aborting reading." << std::endl;
+    _closeFileThings();
+    return false;
+  }
+
+  dset_dspace.id = H5Dget_space(dset_id);
+  hid_t file_type = H5Dget_type(dset_id);
+  bool types_ok = _checkTypes(file_type);
+  H5Tclose(file_type);
+  if(!types_ok || !_selectFileHyperslab(first_row, num_rows))
+  {
+    _closeFileThings();
+    return false;
+  }
+
+  if(H5Sget_select_npoints(dset_dspace.id) != H5Sget_select_npoints(mem_dspace.id))
+  {
+    H5IO_VERBOSE_COUT << "Selected " << H5Sget_select_npoints(dset_dspace.id) << " elements in file but "
+      << H5Sget_select_npoints(mem_dspace.id) << " in memory; aborting read." << std::endl;
+    _closeFileThings();
+    return false;
+  }
+
+  H5IO_DEBUG_COUT << "Reading data..." << std::flush;
+  if(_usingMPI() || !parallel_compression || !_readChunksParallel(array))
+  {
+    status = _readMemSelection(array);
+    if(stats.isEnabled())
+      stats.addBytesRead(H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(mem_dspace.type));
+  }
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+  _closeFileThings();
+  return status >= 0;
+}
+
+/**
+ * @brief Queue a write of an array to be done by the background I/O thread
+ * @details The array is copied into a staging buffer before this returns,
+ * so it may be changed straight away. Staging buffers are recycled; at most
+ * (queue size + 1) exist at once. Blocks while the queue is full.
+ *
+ * The memory hyperslab and dataset type in effect now are used for the
+ * write; other settings (compression, chunking, ...) are those in effect
+ * when the write starts. Writes run in the order they were queued, and
+ * synchronous calls (writeArrayToFile, readArrayFromFile, flushFile,
+ * closeFile, ...) first wait for all queued writes.
+ *
+ * @param array array in memory with the dimensions given to the constructor
+ * @param file_name name of file
+ * @param dset_name path to dataset
+ * @param append_flag append to dataset (see writeArrayToFile)
+ *
+ * @return future that becomes the return value of the write
+ */
+std::future<bool> H5IO::writeArrayToFileAsync(const void *array, std::string file_name, std::string dset_name, bool append_flag)
+{
+  if(_writeSynchronously())
+  {
+    std::promise<bool> written;
+    written.set_value(writeArrayToFile(const_cast<void *>(array), file_name, dset_name, append_flag));
+    return written.get_future();
+  }
+
+  size_t bytes = _getMemBytes();
+  std::shared_ptr< std::vector<char> > staging;
+  {
+    std::unique_lock<std::mutex> lock(async_mutex);
+    async_cv.wait(lock, [&]{ return async_queue.size() < async_queue_size; });
+    if(!staging_buffers.empty())
+    {
+      staging = staging_buffers.back();
+      staging_buffers.pop_back();
+    }
+  }
+  if(!staging)
+    staging = std::make_shared< std::vector<char> >();
+  staging->resize(bytes);
+  std::memcpy(&(*staging)[0], array, bytes);
+
+  return _queueAsyncWrite(staging, &(*staging)[0], staging, file_name, dset_name, append_flag);
 }
 
-void H5IO::setMemHyperslab(H5SizeArray &start_in, H5SizeArray &stride_in)
+/**
+ * @brief Queue a write of data owned by owner_in
+ * @details owner_in is kept alive until the write is done. staging is
+ * handed back to staging_buffers afterwards if it is set.
+ */
+std::future<bool> H5IO::_queueAsyncWrite(std::shared_ptr<void> owner_in, const void *array,
+  std::shared_ptr< std::vector<char> > staging, std::string file_name, std::string dset_name, bool append_flag)
 {
-  mem_dspace.start = start_in;
-  mem_dspace.stride = stride_in;
+  if(_writeSynchronously())
+  {
+    std::promise<bool> written;
+    written.set_value(writeArrayToFile(const_cast<void *>(array), file_name, dset_name, append_flag));
+    return written.get_future();
+  }
 
-  mem_dspace.setHyperslab();
+  AsyncJob job;
+  job.owner = owner_in;
+  job.staging = staging;
+  job.array = array;
+  job.file_name = file_name;
+  job.dset_name = dset_name;
+  job.append_flag = append_flag;
+  job.dset_type = dset_dspace.type;
+  if(!append_flag)
+  {
+    job.dirty_start.swap(dirty_start);
+    job.dirty_count.swap(dirty_count);
+  }
+  for(int i = 0; i < mem_dspace.getRank(); ++i)
+  {
+    job.start.push_back(mem_dspace.start[i]);
+    job.stride.push_back(mem_dspace.stride[i]);
+  }
+  std::future<bool> result = job.done.get_future();
+
+  std::unique_lock<std::mutex> lock(async_mutex);
+  async_cv.wait(lock, [&]{ return async_queue.size() < async_queue_size; });
+  if(!async_thread.joinable())
+  {
+    if(!async_io)
+    {
+      H5SizeArray dims(mem_dspace.getRank());
+      dims = mem_dspace.dims;
+      async_io.reset(new H5IO(mem_dspace.getRank(), dims, mem_dspace.type));
+    }
+    async_stop = false;
+    async_thread = std::thread(&H5IO::_asyncWriter, this);
+  }
+  async_queue.push_back(std::move(job));
+  async_cv.notify_all();
+  return result;
 }
 
-void H5IO::setMemHyperslab1D(int print_dim, H5SizeArray &start_in, hsize_t stride_in)
+/**
+ * @brief Main loop of the background I/O thread
+ */
+void H5IO::_asyncWriter()
 {
-  mem_dspace.start = start_in;
-  //set stride too large so that count will be 1
-  mem_dspace.stride = mem_dspace.dims;
-  //fix stride in print dim to be reasonable
-  mem_dspace.stride[print_dim] = stride_in;
+  std::unique_lock<std::mutex> lock(async_mutex);
+  while(true)
+  {
+    async_cv.wait(lock, [&]{ return async_stop || !async_queue.empty(); });
+    if(async_queue.empty())
+      return;
+
+    AsyncJob job = std::move(async_queue.front());
+    async_queue.pop_front();
+    async_busy = true;
+    async_cv.notify_all();
+    lock.unlock();
+
+    job.done.set_value(_runAsyncJob(job));
+
+    lock.lock();
+    if(job.staging)
+      staging_buffers.push_back(job.staging);
+    async_busy = false;
+    async_cv.notify_all();
+  }
+}
 
-  mem_dspace.setHyperslab();
+/**
+ * @brief Copy settings from another H5IO
+ * @details Used to give async_io, and the H5IOs writing subfiles (see
+ * _writeSubfiles), the settings of the H5IO that made them;
+ * source.settings_mutex must be held.
+ */
+void H5IO::_copySettings(H5IO &source)
+{
+  setVerbosity(source.verbosity_level);
+  if(append_buffer_rows != source.append_buffer_rows)
+    setAppendBufferRows(source.append_buffer_rows);
+  if(thread_pool.getThreads() != source.thread_pool.getThreads())
+    setThreads(source.thread_pool.getThreads());
+  if(access != source.access)
+    setAccess(source.access);
+
+  H5IO_LOCK_SETTINGS;
+  persistent_file = source.persistent_file;
+  append_chunk_rows = source.append_chunk_rows;
+  chunk_mode = source.chunk_mode;
+  chunk_target_bytes = source.chunk_target_bytes;
+  chunk_dims.setRank(source.chunk_dims.getRank());
+  chunk_dims = source.chunk_dims;
+  chunk_access.setRank(source.chunk_access.getRank());
+  chunk_access = source.chunk_access;
+  compression = source.compression;
+  dataset_compression = source.dataset_compression;
+  parallel_compression = source.parallel_compression;
+  stats.setEnabled(source.stats.isEnabled());
+  overwrite = source.overwrite;
+  incremental = source.incremental;
+  pyramid_levels = source.pyramid_levels;
+  pyramid_method = source.pyramid_method;
+  subfiles = source.subfiles;
+  subfile_axis = source.subfile_axis;
+  chunk_stats_enabled = source.chunk_stats_enabled;
+  chunk_stats_bins = source.chunk_stats_bins;
+  chunk_stats_min = source.chunk_stats_min;
+  chunk_stats_max = source.chunk_stats_max;
+  type_check = source.type_check;
+  chunk_hashes = source.chunk_hashes;
 }
 
-void H5IO::setMemHyperslabNm1D(int drop_dim, H5SizeArray &start_in, H5SizeArray &stride_in)
+/**
+ * @brief Do a queued write on async_io
+ * @details async_io takes the current settings of this H5IO and the
+ * hyperslab and dataset type the write was queued with.
+ */
+bool H5IO::_runAsyncJob(AsyncJob &job)
 {
-  mem_dspace.start = start_in;
-  mem_dspace.stride = stride_in;
+  {
+    H5IO_LOCK_SETTINGS;
+    async_io->_copySettings(*this);
+  }
 
-  //ensure stride in drop dim is too large so count will be 1
-  mem_dspace.stride[drop_dim] = mem_dspace.dims[drop_dim];
+  for(int i = 0; i < async_io->mem_dspace.getRank(); ++i)
+  {
+    async_io->mem_dspace.start[i] = job.start[i];
+    async_io->mem_dspace.stride[i] = job.stride[i];
+  }
+  {
+    H5IO_LOCK_LIBRARY;
+    async_io->mem_dspace.setHyperslab();
+  }
+  async_io->dset_dspace.type = job.dset_type;
+  async_io->dirty_start.swap(job.dirty_start);
+  async_io->dirty_count.swap(job.dirty_count);
 
-  mem_dspace.setHyperslab();
+  return async_io->writeArrayToFile(const_cast<void *>(job.array), job.file_name, job.dset_name, job.append_flag);
 }
 
-bool H5IO::readArrayFromFile(void *array, std::string file_name, std::string dset_name)
+/**
+ * @brief Wait until all queued asynchronous writes are done
+ * @details Rows they buffered for appending (see setAppendBufferRows) are
+ * written too.
+ */
+void H5IO::waitForAsyncWrites()
+{
+  {
+    std::unique_lock<std::mutex> lock(async_mutex);
+    async_cv.wait(lock, [&]{ return async_queue.empty() && !async_busy; });
+  }
+  if(async_io)
+    async_io->flushAppendBuffers();
+}
+
+/**
+ * @brief Set number of writes that can be queued before
+ * writeArrayToFileAsync blocks
+ *
+ * @param size_in queue size (default 2)
+ */
+void H5IO::setAsyncQueueSize(size_t size_in)
 {
-  _openOrCreateFile(file_name, true);
+  std::lock_guard<std::mutex> lock(async_mutex);
+  async_queue_size = (size_in > 0 ? size_in : 1);
+  async_cv.notify_all();
+}
 
-  if(!_checkDatasetExists(dset_name, true))
+/**
+ * @brief Finish queued writes and stop the background I/O thread
+ */
+void H5IO::_stopAsyncWriter()
+{
   {
-    H5IO_DEBUG_COUT << "Can't read dataset that does not exist. Aborting reading." << std::endl;
-    return false;
+    std::lock_guard<std::mutex> lock(async_mutex);
+    async_stop = true;
   }
-  
-  status = H5Dread(dset_id, mem_dspace.type, mem_dspace.id,
-		   dset_dspace.id, H5P_DEFAULT, array);
-  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
-  _closeFileThings();
-  return true;
+  async_cv.notify_all();
+  if(async_thread.joinable())
+    async_thread.join();
+  async_io.reset();
+}
+
+/**
+ * @brief Size in bytes of the whole array in memory
+ */
+size_t H5IO::_getMemBytes()
+{
+  size_t bytes = H5Tget_size(mem_dspace.type);
+  for(int i = 0; i < mem_dspace.getRank(); ++i)
+    bytes *= mem_dspace.dims[i];
+  return bytes;
 }
 
 bool H5IO::writeArrayToFile(void *array, std::string file_name, std::string dset_name, bool append_flag)
 {
-  _openOrCreateFile(file_name,false);
+  waitForAsyncWrites();
+  // before taking the library lock: the subfiles are written on other threads
+  if(subfiles > 1 && !append_flag)
+    return _writeSubfiles(array, file_name, dset_name);
+  H5IO_LOCK_LIBRARY;
+
+#ifdef H5IO_MPI
+  if(mpi_enabled && append_flag)
+  {
+    H5IO_VERBOSE_COUT << "Appending is not supported with MPI. Aborting write." << std::endl;
+    return false;
+  }
+#endif
+
+  if(!_checkTypes(dset_dspace.type))
+  {
+    clearDirty();
+    return false;
+  }
+
+  if(append_flag && append_buffer_rows > 1)
+    return _bufferAppend(array, file_name, dset_name);
+
+  if(!_openOrCreateFile(file_name,false))
+    return false;
 
+  std::string key = file_name + ":" + dset_name;
+  new_hashes.clear();
+  chunk_stats_fused = false;
   if(append_flag)
   {
-    //check if dataset does NOT exists
-    if( ! _checkDatasetExists(dset_name, false) )
-        _createCloseDatasetAppend(dset_name);
+    std::vector<hsize_t> row_dims;
+    _getRowDims(row_dims);
 
-    H5IO_DEBUG_COUT << "Opening dataset..." << std::flush;
-    dset_id = H5Dopen( file_id, dset_name.c_str() , H5P_DEFAULT);
-    H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+    //check if dataset does NOT exists
+    if( ! _checkDatasetExists(dset_name) )
+      if( ! _createOpenDatasetAppend(dset_name, row_dims) )
+        return false;
 
-    if (! _setAppend())
+    if (! _setAppend(row_dims, 1))
       return false;
   } else { //create new file
-    if( _checkDatasetExists(dset_name, false) ) {
+    bool exists = _checkDatasetExists(dset_name);
+    if( exists && !overwrite ) {
       H5IO_DEBUG_COUT << "Can't write dataset to one that exists. Aborting write." << std::endl;
+      clearDirty();
+      return false;
+    }
+    else if( exists && !_checkOverwrite() ) {
+      clearDirty();
+      _closeFileThings();
+      return false;
+    }
+    else if( !exists && ! _createOpenDataset(dset_name) ) {
+      clearDirty();
       return false;
     }
+
+    // write only what changed, if possible
+    bool handled = false;
+    if(exists && !dirty_start.empty())
+      handled = _writeDirtyRegions(array, key);
+    else if(incremental)
+      handled = _writeChangedChunks(array, key, exists);
     else
-      _createOpenDataset(dset_name);
+      chunk_hashes->erase(key);
+    clearDirty();
+
+    if(!handled && parallel_compression && !_usingMPI())
+      handled = _writeChunksParallel(array);
+    if(handled)
+    {
+      if(status >= 0 && !new_hashes.empty())
+        (*chunk_hashes)[key].swap(new_hashes);
+      if(status >= 0 && (!_writeChunkStats(array, dset_name) || !_writePyramid(array, dset_name)))
+        status = -1;
+      _closeFileThings();
+      return status >= 0;
+    }
   }
   H5IO_DEBUG_COUT << "Writing data..." << std::flush;
-  status = H5Dwrite(dset_id, mem_dspace.type, mem_dspace.id, dset_dspace.id, H5P_DEFAULT, array);
+  status = _writeMemSelection(array);
+  if(stats.isEnabled())
+    stats.addBytesWritten(H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(mem_dspace.type));
   H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
 
+  if(status >= 0 && !new_hashes.empty())
+    (*chunk_hashes)[key].swap(new_hashes);
+  if(status >= 0 && !append_flag && (!_writeChunkStats(array, dset_name) || !_writePyramid(array, dset_name)))
+    status = -1;
 
-  //status = dset_dspace.closeSpace();
   _closeFileThings();
 
-  return true;
+  return status >= 0;
+}
+
+/**
+ * @brief Write several arrays with the memory hyperslab to new datasets
+ * of one file
+ * @details Like calling writeArrayToFile for each item, but the file is
+ * opened once and the dataset dataspace and creation property list are made
+ * once and shared by all new datasets (a new property list is only made
+ * when the type or compression changes). Built with H5IO_WRITE_MULTI and
+ * HDF5 1.14 or later, arrays that need no packing or conversion are written
+ * with one H5Dwrite_multi.
+ *
+ * Items whose datasets exist already, and all items when writing with MPI,
+ * parallel compression, overwriting or subfiles (see setSubfiles), go
+ * through writeArrayToFile.
+ * Totals are available from getBatchReport afterwards.
+ *
+ * @param items arrays, dataset names and (optionally) types
+ * @param file_name name of file
+ * @return true if every array was written
+ */
+bool H5IO::writeArraysToFile(const std::vector<H5IOBatchItem> &items, std::string file_name)
+{
+  waitForAsyncWrites();
+  H5IO_LOCK_LIBRARY;
+  std::chrono::steady_clock::time_point batch_start = std::chrono::steady_clock::now();
+  batch_report = H5IOBatchReport();
+
+  if(!_openOrCreateFile(file_name, false))
+    return false;
+
+  hid_t mem_type = mem_dspace.type,
+        dset_type = dset_dspace.type;
+  bool shared = !_usingMPI() && !parallel_compression && !overwrite && dirty_start.empty() && pyramid_levels == 0
+    && !chunk_stats_enabled && subfiles <= 1;
+  bool written = true;
+  std::vector<const H5IOBatchItem *> others; //items left to writeArrayToFile
+
+  std::vector<hsize_t> dims;
+  _getDatasetDims(dims);
+  dset_dspace.setRank(dims.size());
+  for(size_t i = 0; i < dims.size(); ++i)
+    dset_dspace.dims[i] = dims[i];
+  dset_dspace.maxdims = dset_dspace.dims;
+  dset_dspace.createSpace();
+
+  hid_t plist_type = -1; //type and compression dset_chunk_plist was made for
+  const H5Compression *plist_compression = NULL;
+  std::vector<hid_t> multi_dsets, //datasets left for H5Dwrite_multi
+                     multi_types;
+  std::vector<const void *> multi_arrays;
+
+  for(size_t n = 0; n < items.size(); ++n)
+  {
+    const H5IOBatchItem &item = items[n];
+    mem_dspace.type = (item.type < 0 ? mem_type : item.type);
+    dset_dspace.type = (item.type < 0 ? dset_type : item.type);
+    if(!shared || file.openDataset(item.dset_name) >= 0)
+    {
+      others.push_back(&item);
+      continue;
+    }
+    std::string dset_name = item.dset_name;
+    if(!_checkTypes(dset_dspace.type) || !_createGroups(dset_name))
+    {
+      written = false;
+      continue;
+    }
+
+    const H5Compression *item_compression = &_getCompression(dset_name);
+    if(!plist_compression || plist_compression != item_compression || H5Tequal(plist_type, dset_dspace.type) <= 0)
+    {
+      if(plist_compression)
+        H5Pclose(dset_chunk_plist);
+      _setChunkDims();
+      _setCompressionPList(dset_name);
+      plist_compression = item_compression;
+      plist_type = dset_dspace.type;
+    }
+
+    {
+      H5IOStats::Timer timer(stats, H5IOStats::dataset_create);
+      dset_id = H5Dcreate(file_id, dset_name.c_str(), dset_dspace.type, dset_dspace.id, file.getLinkPList(), dset_chunk_plist, file.getDatasetAccessPList());
+    }
+    if(dset_id < 0)
+    {
+      H5IO_VERBOSE_COUT << "Could not create dataset '" << dset_name << "'." << std::endl << std::flush;
+      written = false;
+      continue;
+    }
+    file.addDataset(dset_name, dset_id);
+    chunk_hashes->erase(file_name + ":" + dset_name);
+
+    size_t bytes = H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(mem_dspace.type);
+#if defined(H5IO_WRITE_MULTI) && H5_VERSION_GE(1,14,0)
+    if(_memSelectionIsAll() && H5Tequal(mem_dspace.type, dset_dspace.type) > 0)
+    {
+      multi_dsets.push_back(dset_id);
+      multi_types.push_back(mem_dspace.type);
+      multi_arrays.push_back(item.array);
+      continue;
+    }
+#endif
+    H5IO_DEBUG_COUT << "Writing " << dset_name << "..." << std::flush;
+    if(_writeMemSelection(item.array) < 0)
+    {
+      written = false;
+      continue;
+    }
+    H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+    stats.addBytesWritten(bytes);
+    batch_report.datasets++;
+    batch_report.bytes += bytes;
+  }
+  if(plist_compression)
+    H5Pclose(dset_chunk_plist);
+
+#if defined(H5IO_WRITE_MULTI) && H5_VERSION_GE(1,14,0)
+  if(!multi_dsets.empty())
+  {
+    size_t count = multi_dsets.size();
+    std::vector<hid_t> mem_spaces(count, mem_dspace.id),
+                       file_spaces(count, dset_dspace.id);
+    herr_t multi_status;
+    {
+      H5IOStats::Timer timer(stats, H5IOStats::write);
+      multi_status = H5Dwrite_multi(count, &multi_dsets[0], &multi_types[0], &mem_spaces[0],
+        &file_spaces[0], dset_xfer_plist, &multi_arrays[0]);
+    }
+    if(multi_status < 0)
+      written = false;
+    else
+      for(size_t i = 0; i < count; ++i)
+      {
+        size_t bytes = H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(multi_types[i]);
+        stats.addBytesWritten(bytes);
+        batch_report.datasets++;
+        batch_report.bytes += bytes;
+      }
+  }
+#endif
+  _closeFileThings();
+
+  // writeArrayToFile may write subfiles on threads that need the lock
+  std::vector<size_t> others_bytes(others.size());
+  for(size_t n = 0; n < others.size(); ++n)
+    others_bytes[n] = H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(others[n]->type < 0 ? mem_type : others[n]->type);
+  library_lock.unlock();
+
+  for(size_t n = 0; n < others.size(); ++n)
+  {
+    mem_dspace.type = (others[n]->type < 0 ? mem_type : others[n]->type);
+    dset_dspace.type = (others[n]->type < 0 ? dset_type : others[n]->type);
+    if(writeArrayToFile(others[n]->array, file_name, others[n]->dset_name, false))
+    {
+      batch_report.datasets++;
+      batch_report.bytes += others_bytes[n];
+    }
+    else
+      written = false;
+  }
+  mem_dspace.type = mem_type;
+  dset_dspace.type = dset_type;
+
+  batch_report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batch_start).count();
+  H5IO_VERBOSE_COUT << "Wrote " << batch_report.datasets << " of " << items.size() << " datasets, "
+    << batch_report.bytes << " bytes in " << batch_report.seconds << " s ("
+    << batch_report.getMBPerSecond() << " MB/s)." << std::endl;
+  return written;
+}
+
+/**
+ * @brief Read whole datasets of chunks, overlapping reading and decoding
+ * @details Candidates that H5ChunkIO can decode (datasets stored in the
+ * memory type, with as many elements as the memory selection, deflate or
+ * shuffle+deflate) have their raw chunks read by this thread while the
+ * previous batch of chunks is decoded on the thread pool; a helper thread
+ * drives the pool so this one is free to call HDF5. The rest are added to
+ * others.
+ */
+void H5IO::_readChunksPipelined(std::vector<H5IOReadItem> &items, std::vector<size_t> &candidates, std::vector<size_t> &others)
+{
+  struct Source //a dataset read here
+  {
+    size_t item;
+    hid_t dset;
+    H5ChunkIO layout;
+    bool failed;
+    std::chrono::steady_clock::time_point start,
+                                          end;
+  };
+  std::vector<Source> sources;
+
+  hssize_t mem_points = H5Sget_select_npoints(mem_dspace.id);
+  for(size_t n = 0; n < candidates.size(); ++n)
+  {
+    H5IOReadItem &item = items[candidates[n]];
+    Source source;
+    source.item = candidates[n];
+    source.failed = false;
+    if(!_checkDatasetExists(item.dset_name))
+    {
+      others.push_back(candidates[n]);
+      continue;
+    }
+    source.dset = dset_id;
+
+    hid_t file_type = H5Dget_type(dset_id),
+          file_space = H5Dget_space(dset_id);
+    bool usable = H5Tequal(mem_dspace.type, file_type) > 0 && H5Sget_simple_extent_npoints(file_space) == mem_points;
+    H5Tclose(file_type);
+    H5Sclose(file_space);
+    if(usable && source.layout.setup(dset_id))
+      sources.push_back(source);
+    else
+      others.push_back(candidates[n]);
+  }
+
+  struct Slot //one chunk on its way from the file to an array
+  {
+    size_t source;
+    hsize_t chunk;
+    uint32_t filter_mask;
+    bool ok;
+    std::vector<char> raw,
+                      scratch,
+                      chunk_data;
+  };
+  size_t batch = thread_pool.getThreads() * 4;
+  std::vector<Slot> slots[2];
+  slots[0].resize(batch);
+  slots[1].resize(batch);
+
+  size_t next_source = 0;
+  hsize_t next_chunk = 0;
+  std::function<size_t(std::vector<Slot> &)> read_batch = [&](std::vector<Slot> &set) {
+    H5IOStats::Timer timer(stats, H5IOStats::read);
+    size_t n = 0;
+    for(; n < batch && next_source < sources.size(); ++n)
+    {
+      Source &source = sources[next_source];
+      if(next_chunk == 0)
+        source.start = std::chrono::steady_clock::now();
+      set[n].source = next_source;
+      set[n].chunk = next_chunk;
+      set[n].ok = source.layout.readRawChunk(source.dset, next_chunk, set[n].raw, set[n].filter_mask);
+      if(++next_chunk == source.layout.getNumChunks())
+      {
+        next_chunk = 0;
+        ++next_source;
+      }
+    }
+    return n;
+  };
+  std::function<void(std::vector<Slot> &, size_t)> decode_batch = [&](std::vector<Slot> &set, size_t n) {
+    H5IOStats::Timer timer(stats, H5IOStats::compression);
+    thread_pool.parallelFor(n, [&](size_t i) {
+      Slot &slot = set[i];
+      H5ChunkIO &layout = sources[slot.source].layout;
+      if(!slot.ok)
+        return;
+      slot.chunk_data.resize(layout.getChunkBytes());
+      if(slot.raw.empty())
+        std::memset(&slot.chunk_data[0], 0, slot.chunk_data.size());
+      else if(!layout.decode(slot.raw, slot.filter_mask, slot.scratch, &slot.chunk_data[0]))
+      {
+        slot.ok = false;
+        return;
+      }
+      layout.insertChunk(&slot.chunk_data[0], slot.chunk, (char *) items[sources[slot.source].item].array);
+    });
+  };
+
+  if(!sources.empty())
+    H5IO_DEBUG_COUT << "Reading " << sources.size() << " datasets on "
+      << thread_pool.getThreads() << " threads..." << std::flush;
+  int current = 0;
+  size_t n = read_batch(slots[current]);
+  while(n > 0)
+  {
+    std::thread decoder(decode_batch, std::ref(slots[current]), n);
+    size_t next_n = read_batch(slots[1 - current]);
+    decoder.join();
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < n; ++i)
+    {
+      Source &source = sources[slots[current][i].source];
+      source.failed = source.failed || !slots[current][i].ok;
+      source.end = now;
+    }
+    current = 1 - current;
+    n = next_n;
+  }
+
+  size_t bytes = mem_points * H5Tget_size(mem_dspace.type);
+  for(size_t s = 0; s < sources.size(); ++s)
+  {
+    H5IOReadItem &item = items[sources[s].item];
+    item.read = !sources[s].failed;
+    item.bytes = (item.read ? bytes : 0);
+    item.seconds = std::chrono::duration<double>(sources[s].end - sources[s].start).count();
+    if(item.read && stats.isEnabled())
+      stats.addBytesRead(bytes);
+  }
+  if(!sources.empty())
+    H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+}
+
+/**
+ * @brief Read many datasets of one file
+ * @details Like calling readArrayFromFile (or, for items with a box,
+ * setFileHyperslab and readArrayFromFile) for each item, but the file is
+ * opened once and, with parallel compression on, whole compressed
+ * datasets are decompressed on the thread pool while the next chunks are
+ * being read (see _readChunksPipelined). Each item records whether it was
+ * read, its bytes and its time; getBatchReport has the totals.
+ *
+ * @param items arrays to read into, dataset names and optional boxes
+ * @param file_name name of file
+ * @return true if every dataset was read
+ */
+bool H5IO::readArraysFromFile(std::vector<H5IOReadItem> &items, std::string file_name)
+{
+  waitForAsyncWrites();
+  flushAppendBuffers();
+  H5IO_LOCK_LIBRARY;
+  std::chrono::steady_clock::time_point batch_start = std::chrono::steady_clock::now();
+  batch_report = H5IOBatchReport();
+  for(size_t n = 0; n < items.size(); ++n)
+  {
+    items[n].read = false;
+    items[n].bytes = 0;
+    items[n].seconds = 0;
+  }
+
+  if(!_openOrCreateFile(file_name, true))
+    return false;
+  bool persistent = persistent_file;
+  persistent_file = true; //keep the file open for the whole batch
+
+  std::vector<size_t> candidates, others;
+  for(size_t n = 0; n < items.size(); ++n)
+  {
+    if(parallel_compression && !_usingMPI() && !file_slab_set && items[n].start.getRank() == 0 && _memSelectionIsAll())
+      candidates.push_back(n);
+    else
+      others.push_back(n);
+  }
+  _readChunksPipelined(items, candidates, others);
+
+  H5SParams saved_slab(file_slab.getRank());
+  saved_slab.start = file_slab.start;
+  saved_slab.stride = file_slab.stride;
+  saved_slab.count = file_slab.count;
+  saved_slab.block = file_slab.block;
+  bool saved_slab_set = file_slab_set;
+  for(size_t n = 0; n < others.size(); ++n)
+  {
+    H5IOReadItem &item = items[others[n]];
+    if(item.start.getRank() > 0)
+      setFileHyperslab(item.start, item.count);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    item.read = _readArrayFromFile(item.array, file_name, item.dset_name, 0, 0);
+    item.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    item.bytes = (item.read ? H5Sget_select_npoints(mem_dspace.id) * H5Tget_size(mem_dspace.type) : 0);
+    if(item.start.getRank() > 0)
+    {
+      file_slab.setRank(saved_slab.getRank());
+      file_slab.start = saved_slab.start;
+      file_slab.stride = saved_slab.stride;
+      file_slab.count = saved_slab.count;
+      file_slab.block = saved_slab.block;
+      file_slab_set = saved_slab_set;
+    }
+  }
+
+  persistent_file = persistent;
+  if(!persistent_file)
+    file.close();
+
+  bool all_read = true;
+  for(size_t n = 0; n < items.size(); ++n)
+  {
+    H5IO_DEBUG_COUT << items[n].dset_name << ": " << items[n].bytes << " bytes in "
+      << items[n].seconds << " s (" << items[n].getMBPerSecond() << " MB/s)" << std::endl;
+    all_read = all_read && items[n].read;
+    batch_report.datasets += (items[n].read ? 1 : 0);
+    batch_report.bytes += items[n].bytes;
+  }
+  batch_report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batch_start).count();
+  H5IO_VERBOSE_COUT << "Read " << batch_report.datasets << " of " << items.size() << " datasets, "
+    << batch_report.bytes << " bytes in " << batch_report.seconds << " s ("
+    << batch_report.getMBPerSecond() << " MB/s)." << std::endl;
+  return all_read;
+}
+
+/**
+ * @brief Read only the chunks of a dataset that may hold values in
+ * [min_in, max_in]
+ * @details Uses the index written with setChunkStats to skip chunks whose
+ * values all lie outside the range (eg. min_in = threshold and max_in =
+ * infinity for values above a threshold). Elements of the array outside
+ * the chunks read are left as they are. With parallel compression, chunks
+ * are decompressed on the thread pool. The whole dataset must be read into
+ * the whole array: no file hyperslab, and a memory hyperslab covering the
+ * array. Not available with MPI.
+ *
+ * @param array array the size of the dataset
+ * @param file_name name of file
+ * @param dset_name name of dataset
+ * @param min_in lowest value of interest
+ * @param max_in highest value of interest
+ * @param starts_out first element of each chunk read
+ * @param counts_out dimensions of each chunk read (clipped to the dataset)
+ * @return true if the chunks were read
+ */
+bool H5IO::readArrayWhere(void *array, std::string file_name, std::string dset_name, double min_in, double max_in,
+  std::vector<H5SizeArray> &starts_out, std::vector<H5SizeArray> &counts_out)
+{
+  waitForAsyncWrites();
+  flushAppendBuffers();
+  H5IO_LOCK_LIBRARY;
+  starts_out.clear();
+  counts_out.clear();
+
+  if(!_openOrCreateFile(file_name, true))
+    return false;
+
+  H5ChunkIO layout;
+  H5ChunkStats index;
+  hid_t index_id = -1;
+  if(!_checkDatasetExists(dset_name) || !layout.setupLayout(dset_id)
+      || (index_id = file.openDataset(H5ChunkStats::getIndexName(dset_name))) < 0
+      || !index.read(index_id) || index.getNumChunks() != layout.getNumChunks())
+  {
+    H5IO_VERBOSE_COUT << "Dataset '" << dset_name << "' has no chunk statistics. Aborting read." << std::endl;
+    _closeFileThings();
+    return false;
+  }
+
+  dset_dspace.id = H5Dget_space(dset_id);
+  hid_t file_type = H5Dget_type(dset_id);
+  bool types_ok = _checkTypes(file_type),
+       same_type = H5Tequal(mem_dspace.type, file_type) > 0;
+  H5Tclose(file_type);
+  if(!types_ok || _usingMPI() || file_slab_set || !_memSelectionIsAll()
+      || H5Sget_select_npoints(mem_dspace.id) != H5Sget_simple_extent_npoints(dset_dspace.id))
+  {
+    H5IO_VERBOSE_COUT << "readArrayWhere reads whole datasets into whole arrays, without MPI. Aborting read." << std::endl;
+    _closeFileThings();
+    return false;
+  }
+
+  std::vector<hsize_t> chunks;
+  index.findChunks(min_in, max_in, chunks);
+  H5IO_DEBUG_COUT << "Reading " << chunks.size() << " of " << layout.getNumChunks() << " chunks..." << std::flush;
+
+  H5ChunkIO chunk_io;
+  if(parallel_compression && same_type && chunk_io.setup(dset_id))
+    status = (chunk_io.readChunks(dset_id, array, thread_pool, stats, &chunks) ? 0 : -1);
+  else
+  {
+    int rank = H5Sget_simple_extent_ndims(dset_dspace.id);
+    std::vector<hsize_t> offset(rank), extent(rank);
+    hid_t array_space = H5Scopy(dset_dspace.id);
+    H5IOStats::Timer timer(stats, H5IOStats::read);
+    status = 0;
+    for(size_t n = 0; n < chunks.size() && status >= 0; ++n)
+    {
+      layout.getChunkRegion(chunks[n], &offset[0], &extent[0]);
+      H5Sselect_hyperslab(dset_dspace.id, H5S_SELECT_SET, &offset[0], NULL, &extent[0], NULL);
+      H5Sselect_hyperslab(array_space, H5S_SELECT_SET, &offset[0], NULL, &extent[0], NULL);
+      status = H5Dread(dset_id, mem_dspace.type, array_space, dset_dspace.id, dset_xfer_plist, array);
+    }
+    H5Sclose(array_space);
+  }
+  H5IO_DEBUG_COUT << "Done!" << std::endl << std::flush;
+
+  if(status >= 0)
+  {
+    int rank = H5Sget_simple_extent_ndims(dset_dspace.id);
+    std::vector<hsize_t> offset(rank), extent(rank);
+    hsize_t elements = 0;
+    for(size_t n = 0; n < chunks.size(); ++n)
+    {
+      layout.getChunkRegion(chunks[n], &offset[0], &extent[0]);
+      H5SizeArray start(rank), count(rank);
+      hsize_t chunk_elements = 1;
+      for(int i = 0; i < rank; ++i)
+      {
+        start[i] = offset[i];
+        count[i] = extent[i];
+        chunk_elements *= extent[i];
+      }
+      starts_out.push_back(start);
+      counts_out.push_back(count);
+      elements += chunk_elements;
+    }
+    if(stats.isEnabled())
+      stats.addBytesRead(elements * H5Tget_size(mem_dspace.type));
+  }
+
+  _closeFileThings();
+  return status >= 0;
+}
+
+/**
+ * @brief Get the totals of the last writeArraysToFile or readArraysFromFile
+ */
+const H5IOBatchReport & H5IO::getBatchReport()
+{
+  return batch_report;
 }
@@ -4,11 +4,83 @@
 #ifndef H5IO_h
 #define H5IO_h
 
+#ifdef H5IO_MPI
+#include <mpi.h>
+#endif
 #include <hdf5.h>
 #include <iostream>
 #include <vector>
+#include <string>
+#include <map>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <stdint.h>
 #include "H5SizeArray.h"
 #include "H5SParams.h"
+#include "H5File.h"
+#include "H5Compression.h"
+#include "H5ThreadPool.h"
+#include "H5MappedArray.h"
+#include "H5IOStats.h"
+#include "H5Convert.h"
+#include "H5Access.h"
+#include "H5Pyramid.h"
+#include "H5ChunkStats.h"
+#include "H5LibraryLock.h"
+
+/**
+ * @brief One array of a batch write, see H5IO::writeArraysToFile
+ */
+struct H5IOBatchItem
+{
+  void *array;
+  std::string dset_name;
+  hid_t type; //type of array and its dataset; negative for the H5IO's types
+
+  H5IOBatchItem(void *array_in, std::string dset_name_in, hid_t type_in = -1)
+  : array(array_in), dset_name(dset_name_in), type(type_in) {}
+};
+
+/**
+ * @brief One dataset of a bulk read, see H5IO::readArraysFromFile
+ */
+struct H5IOReadItem
+{
+  void *array;
+  std::string dset_name;
+  H5SizeArray start, //box of the dataset to read; rank 0 for all of it
+              count;
+
+  bool read; //set by the read: the dataset was read
+  unsigned long long bytes; //set by the read: bytes read into array
+  double seconds; //set by the read: time from its first to its last byte
+
+  H5IOReadItem(void *array_in, std::string dset_name_in)
+  : array(array_in), dset_name(dset_name_in), read(false), bytes(0), seconds(0) {}
+
+  H5IOReadItem(void *array_in, std::string dset_name_in, const H5SizeArray &start_in, const H5SizeArray &count_in)
+  : array(array_in), dset_name(dset_name_in), start(start_in), count(count_in), read(false), bytes(0), seconds(0) {}
+
+  double getMBPerSecond() const { return (seconds > 0 ? bytes / seconds / (1 << 20) : 0); }
+};
+
+/**
+ * @brief Totals of a batch write or read
+ */
+struct H5IOBatchReport
+{
+  size_t datasets; //datasets written
+  unsigned long long bytes; //bytes of arrays written
+  double seconds; //time for the whole batch
+
+  H5IOBatchReport() : datasets(0), bytes(0), seconds(0) {}
+
+  double getMBPerSecond() const { return (seconds > 0 ? bytes / seconds / (1 << 20) : 0); }
+};
 
 /**
  * @brief Class for easy HDF5 file IO
@@ -20,6 +92,36 @@ class H5IO
 private:
   H5SParams mem_dspace, //holds memory dataspace things
             dset_dspace; //holds file dataset dataspace things
+
+  H5SParams file_slab; //hyperslab of datasets to read
+
+  bool file_slab_set; //read file_slab instead of whole datasets
+
+  H5File file; //open file and its cached datasets
+
+  H5IOStats stats; //phase counters and timers, see setStats
+
+  bool persistent_file; //keep file open between calls
+
+  hsize_t append_buffer_rows, //rows collected before an append is written
+          append_chunk_rows; //rows per chunk of append datasets (0 = buffer rows)
+
+  struct AppendBuffer //rows waiting to be appended to one dataset
+  {
+    std::string file_name,
+                dset_name;
+    std::vector<hsize_t> row_dims;
+    hsize_t rows;
+    std::vector<char> data;
+    AppendBuffer() : rows(0) {}
+  };
+
+  std::map<std::string, AppendBuffer> append_buffers; //keyed by file:dataset
+
+  int chunk_mode; //one of enum chunking
+  size_t chunk_target_bytes; //chunk size aimed for by chunk_auto
+  H5SizeArray chunk_dims, //chunk dimensions for chunk_manual
+              chunk_access; //typical access hyperslab for chunk_auto
   
   herr_t status;
   
@@ -27,37 +129,183 @@ private:
         dset_id,
         dset_chunk_plist;
   
-  int compression_level,
-      verbosity_level;
-  H5E_auto2_t default_error_func; //stores function for default h5 error out
-  
-  void *default_error_out; //pointer to default error output
+  H5Compression compression; //compression for new datasets
 
-  void _initialize(int mem_rank_in, H5SizeArray &mem_dims_in, hid_t mem_type_in);
+  H5Access access; //cache, alignment and format settings of files and datasets
 
-  void _pauseH5ErrorHandeling();
-  
-  void _resumeH5ErrorHandeling();
+  std::map<std::string, H5Compression> dataset_compression; //per dataset overrides
+
+  H5ThreadPool thread_pool; //threads for compression and type conversion
+
+  bool parallel_compression; //compress chunks on thread_pool
+
+  std::vector<char> pack_buffer; //scratch space for contiguous copies of data
+
+  std::vector<char> convert_buffer; //scratch space for type conversions
+
+  bool type_check; //fail instead of converting between memory and file types
+
+  bool overwrite, //write into existing datasets
+       incremental; //only rewrite chunks that changed
+
+  int pyramid_levels, //coarser levels written with each array, see setPyramid
+      pyramid_method; //one of H5Pyramid::method
+
+  int subfiles, //files whole arrays are split into, see setSubfiles
+      subfile_axis; //dataset dimension they are split along
+
+  bool chunk_stats_enabled, //write a chunk statistics index with each array, see setChunkStats
+       chunk_stats_fused; //chunk_stats was filled while compressing the write in progress
+  int chunk_stats_bins;
+  double chunk_stats_min,
+         chunk_stats_max;
+  H5ChunkStats chunk_stats; //statistics of the write in progress
+
+  std::vector< std::vector<hsize_t> > dirty_start, //regions to rewrite on the next overwrite
+                                      dirty_count;
+
+  typedef std::map< std::string, std::vector<uint64_t> > ChunkHashes;
+  std::shared_ptr<ChunkHashes> chunk_hashes; //chunk hashes of the last write, keyed by file:dataset
+
+  std::vector<uint64_t> new_hashes; //hashes of the write in progress
+
+  H5IOBatchReport batch_report; //totals of the last writeArraysToFile or readArraysFromFile
+
+  struct AsyncJob //a write queued by writeArrayToFileAsync
+  {
+    std::shared_ptr<void> owner; //keeps array alive
+    std::shared_ptr< std::vector<char> > staging; //staging buffer to recycle, if any
+    const void *array;
+    std::string file_name,
+                dset_name;
+    bool append_flag;
+    std::vector<hsize_t> start, //memory hyperslab when queued
+                         stride;
+    hid_t dset_type; //dataset type when queued
+    std::vector< std::vector<hsize_t> > dirty_start, //dirty regions when queued
+                                        dirty_count;
+    std::promise<bool> done;
+  };
+
+  std::mutex settings_mutex; //guards settings copied by the I/O thread
+
+  std::unique_ptr<H5IO> async_io; //does the writes on the I/O thread
+  std::thread async_thread; //background I/O thread
+  std::mutex async_mutex; //guards the members below
+  std::condition_variable async_cv;
+  std::deque<AsyncJob> async_queue;
+  std::vector< std::shared_ptr< std::vector<char> > > staging_buffers; //free staging buffers
+  size_t async_queue_size;
+  bool async_busy,
+       async_stop;
+
+  hid_t dset_xfer_plist; //dataset transfer property list for H5Dwrite/H5Dread
+
+#ifdef H5IO_MPI
+  bool mpi_enabled; //share one file between MPI ranks
+  MPI_Comm mpi_comm; //ranks sharing the file
+  std::vector<hsize_t> mpi_global_dims, //dimensions of the shared dataset
+                       mpi_offset; //offset of this rank's block
+#endif
+
+  int verbosity_level;
+
+  void _initialize(int mem_rank_in, H5SizeArray &mem_dims_in, hid_t mem_type_in);
 
   bool _openOrCreateFile(std::string file_name, bool read_flag);
 
-  bool _checkCompression();
+  void _setAccessPLists();
 
-  void _split(const std::string &s, char delim, std::vector<std::string> &elems);
+  bool _writeSynchronously();
 
   bool _createGroups(std::string &dset_name);
 
-  bool _createCloseDatasetAppend(std::string dset_name);
+  void _getRowDims(std::vector<hsize_t> &row_dims);
+
+  bool _createOpenDatasetAppend(std::string dset_name, std::vector<hsize_t> &row_dims);
+
+  void _getDatasetDims(std::vector<hsize_t> &dims);
 
   bool _createOpenDataset(std::string dset_name);
 
-  bool _checkAppend();
+  bool _checkOverwrite();
+
+  bool _checkTypes(hid_t file_type);
+
+  bool _writeDirtyRegions(void *array, std::string key);
+
+  bool _writeChangedChunks(void *array, std::string key, bool exists);
+
+  bool _writeChunkStats(void *array, std::string dset_name);
+
+  bool _writePyramid(void *array, std::string dset_name);
+
+  bool _writePyramidLevel(std::string level_name, int level, std::vector<hsize_t> &dims, hid_t dcpl, const void *data);
+
+  bool _writeSubfiles(void *array, std::string file_name, std::string dset_name);
+
+#ifdef H5IO_MPI
+  bool _createOpenDatasetMPI(std::string dset_name);
+
+  void _selectMPIBlock();
+#endif
+
+  bool _usingMPI();
+
+  void _setChunkDims();
+
+  bool _checkAppend(std::vector<hsize_t> &row_dims);
 
-  bool _checkDatasetExists(std::string dset_name, bool read_flag);
+  bool _checkDatasetExists(std::string dset_name);
 
-  void _setCompressionPList();
+  const H5Compression & _getCompression(std::string dset_name);
 
-  bool _setAppend();
+  void _setCompressionPList(std::string dset_name);
+
+  bool _setAppend(std::vector<hsize_t> &row_dims, hsize_t rows);
+
+  bool _bufferAppend(void *array, std::string file_name, std::string dset_name);
+
+  bool _commitAppendBuffer(AppendBuffer &buffer);
+
+  bool _memSelectionIsAll();
+
+  const char * _packMemSelection(void *array);
+
+  void _unpackMemSelection(const char *packed, void *array);
+
+  bool _writeChunksParallel(void *array);
+
+  bool _readChunksParallel(void *array);
+
+  size_t _getMemBytes();
+
+  std::future<bool> _queueAsyncWrite(std::shared_ptr<void> owner_in, const void *array,
+    std::shared_ptr< std::vector<char> > staging, std::string file_name, std::string dset_name, bool append_flag);
+
+  void _asyncWriter();
+
+  void _copySettings(H5IO &source);
+
+  bool _runAsyncJob(AsyncJob &job);
+
+  void _stopAsyncWriter();
+
+  bool _usePackedSelection();
+
+  bool _useConversion(hid_t src_type, hid_t dst_type);
+
+  void _convert(hid_t src_type, hid_t dst_type, const void *src, void *dst, hsize_t n_elements);
+
+  herr_t _writeMemSelection(void *array);
+
+  herr_t _readMemSelection(void *array);
+
+  bool _selectFileHyperslab(hsize_t first_row, hsize_t num_rows);
+
+  bool _readArrayFromFile(void *array, std::string file_name, std::string dset_name, hsize_t first_row, hsize_t num_rows);
+
+  void _readChunksPipelined(std::vector<H5IOReadItem> &items, std::vector<size_t> &candidates, std::vector<size_t> &others);
 
   void _closeFileThings();
 
@@ -65,6 +313,8 @@ public:
 
   enum verbosity {off, verbose, debug};
 
+  enum chunking {chunk_whole, chunk_manual, chunk_auto, chunk_contiguous};
+
   H5IO(int mem_rank_in, H5SizeArray &mem_dims_in, hid_t mem_type_in);
   
   H5IO(int mem_rank_in, hsize_t mem_dim_in, hid_t mem_type_in);
@@ -74,7 +324,75 @@ public:
   void setVerbosity(int verbosity_in);
   
   void setDatasetType(hid_t dataset_type_in);
+
+  void setTypeCheck(bool check_in);
+
+  void setPersistentFile(bool persistent_in);
+
+  void setAccess(const H5Access &access_in);
+
+  bool openFileImage(const void *image, size_t bytes, std::string file_name);
+
+  bool getFileImage(std::vector<char> &image_out);
+
+  bool flushFile();
+
+  void closeFile();
+
+  void setAppendBufferRows(hsize_t rows_in);
+
+  void setAppendChunkRows(hsize_t rows_in);
+
+  bool flushAppendBuffers();
+
+#ifdef H5IO_MPI
+  void setMPI(MPI_Comm comm_in, H5SizeArray &global_dims_in, H5SizeArray &offset_in);
+#endif
+
+  void setThreads(int threads_in);
+
+  void setParallelCompression(bool parallel_in);
+
+  void setCompression(const H5Compression &compression_in);
+
+  void setCompression(int method_in, int level_in);
+
+  void setDatasetCompression(std::string dset_name, const H5Compression &compression_in);
+
+  void setChunkWhole();
+
+  void setContiguous();
+
+  void setOverwrite(bool overwrite_in);
+
+  void setIncremental(bool incremental_in);
+
+  void setPyramid(int levels_in, int method_in);
+
+  void setChunkStats(bool enabled_in, int bins_in, double hist_min_in, double hist_max_in);
+
+  void setSubfiles(int subfiles_in, int axis_in);
+
+  static std::string getSubfileName(std::string file_name, int subfile);
+
+  void markDirty(H5SizeArray &start_in, H5SizeArray &count_in);
+
+  void clearDirty();
+
+  void clearChunkHashes();
+
+  void setChunkDims(H5SizeArray &chunk_in);
+
+  void setChunkAuto(size_t target_bytes_in);
+
+  void setChunkAuto(size_t target_bytes_in, H5SizeArray &access_in);
   
+  void setFileHyperslab(H5SizeArray &start_in, H5SizeArray &stride_in, H5SizeArray &count_in, H5SizeArray &block_in);
+
+  void setFileHyperslab(H5SizeArray &start_in, H5SizeArray &count_in);
+
+  void clearFileHyperslab();
+
   void setMemHyperslab(H5SizeArray &start_in, H5SizeArray &stride_in);
 
   void setMemHyperslab1D(int print_dim, H5SizeArray &start_in, hsize_t stride_in);
@@ -83,7 +401,54 @@ public:
   
   bool writeArrayToFile(void *array, std::string file_name, std::string dset_name, bool append_flag);
 
+  bool writeArraysToFile(const std::vector<H5IOBatchItem> &items, std::string file_name);
+
+  const H5IOBatchReport & getBatchReport();
+
   bool readArrayFromFile(void *arry, std::string file_name, std::string dset_name);
+
+  bool readRowsFromFile(void *array, std::string file_name, std::string dset_name, hsize_t first_row, hsize_t num_rows);
+
+  bool readArraysFromFile(std::vector<H5IOReadItem> &items, std::string file_name);
+
+  bool readArrayWhere(void *array, std::string file_name, std::string dset_name, double min_in, double max_in,
+    std::vector<H5SizeArray> &starts_out, std::vector<H5SizeArray> &counts_out);
+
+  bool mapArrayFromFile(H5MappedArray &view, std::string file_name, std::string dset_name);
+
+  void setStats(bool enabled_in);
+
+  void getStats(H5IOStats &stats_out);
+
+  std::string getStatsJSON();
+
+  void resetStats();
+
+  std::future<bool> writeArrayToFileAsync(const void *array, std::string file_name, std::string dset_name, bool append_flag);
+
+  /**
+   * @brief Queue a write of an array that H5IO takes ownership of
+   * @details Like writeArrayToFileAsync(const void *, ...), but the
+   * vector is moved into the queue instead of being copied. It must hold
+   * the whole array given to the constructor.
+   */
+  template<typename T>
+  std::future<bool> writeArrayToFileAsync(std::vector<T> &&array, std::string file_name, std::string dset_name, bool append_flag)
+  {
+    std::shared_ptr< std::vector<T> > owner = std::make_shared< std::vector<T> >(std::move(array));
+    if(owner->size() * sizeof(T) < _getMemBytes())
+    {
+      std::promise<bool> failed;
+      failed.set_value(false);
+      return failed.get_future();
+    }
+    return _queueAsyncWrite(owner, owner->data(), std::shared_ptr< std::vector<char> >(),
+      file_name, dset_name, append_flag);
+  }
+
+  void waitForAsyncWrites();
+
+  void setAsyncQueueSize(size_t size_in);
 };
 
 #endif
@@ -0,0 +1,118 @@
+#include <atomic>
+#include <string>
+#include <sstream>
+#include "H5IOStats.h"
+
+H5IOStats::H5IOStats()
+: enabled(false)
+{
+  reset();
+}
+
+/**
+ * @brief Turn counting and timing on or off
+ * @details Counts so far are kept; see reset().
+ */
+void H5IOStats::setEnabled(bool enabled_in)
+{
+  enabled = enabled_in;
+}
+
+/**
+ * @brief Record one call of a phase
+ */
+void H5IOStats::add(int phase_in, unsigned long long nanoseconds_in)
+{
+  calls[phase_in].fetch_add(1, std::memory_order_relaxed);
+  nanoseconds[phase_in].fetch_add(nanoseconds_in, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Count bytes handed to HDF5 (before compression)
+ */
+void H5IOStats::addBytesWritten(size_t bytes)
+{
+  if(enabled)
+    bytes_written.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Count bytes returned by HDF5 (after decompression)
+ */
+void H5IOStats::addBytesRead(size_t bytes)
+{
+  if(enabled)
+    bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Add the counts of other to these
+ */
+void H5IOStats::accumulate(const H5IOStats &other)
+{
+  for(int i = 0; i < num_phases; ++i)
+  {
+    calls[i].fetch_add(other.calls[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    nanoseconds[i].fetch_add(other.nanoseconds[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+  bytes_written.fetch_add(other.bytes_written.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  bytes_read.fetch_add(other.bytes_read.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Zero all counts
+ */
+void H5IOStats::reset()
+{
+  for(int i = 0; i < num_phases; ++i)
+  {
+    calls[i] = 0;
+    nanoseconds[i] = 0;
+  }
+  bytes_written = 0;
+  bytes_read = 0;
+}
+
+unsigned long long H5IOStats::getCalls(int phase_in) const
+{
+  return calls[phase_in].load(std::memory_order_relaxed);
+}
+
+double H5IOStats::getSeconds(int phase_in) const
+{
+  return nanoseconds[phase_in].load(std::memory_order_relaxed) * 1.0e-9;
+}
+
+unsigned long long H5IOStats::getBytesWritten() const
+{
+  return bytes_written.load(std::memory_order_relaxed);
+}
+
+unsigned long long H5IOStats::getBytesRead() const
+{
+  return bytes_read.load(std::memory_order_relaxed);
+}
+
+const char * H5IOStats::getPhaseName(int phase_in)
+{
+  static const char *names[num_phases] = {"file_open", "group_create", "dataset_create",
+    "extent_change", "hyperslab_select", "pack", "compression", "conversion", "downsample", "statistics", "write", "read"};
+  return (phase_in >= 0 && phase_in < num_phases ? names[phase_in] : "");
+}
+
+/**
+ * @brief Get all counts as a JSON object
+ * @details Of the form {"phases": {"file_open": {"calls": 1, "seconds":
+ * 0.001}, ...}, "bytes_written": 400, "bytes_read": 0}
+ */
+std::string H5IOStats::toJSON() const
+{
+  std::ostringstream json;
+  json << "{\"phases\": {";
+  for(int i = 0; i < num_phases; ++i)
+    json << (i > 0 ? ", " : "") << "\"" << getPhaseName(i) << "\": {\"calls\": "
+      << getCalls(i) << ", \"seconds\": " << getSeconds(i) << "}";
+  json << "}, \"bytes_written\": " << getBytesWritten()
+    << ", \"bytes_read\": " << getBytesRead() << "}";
+  return json.str();
+}
@@ -0,0 +1,90 @@
+#ifndef H5IOStats_h
+#define H5IOStats_h
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstddef>
+
+/**
+ * @brief Counters and timers for the phases of reads and writes
+ * @details Each phase counts how often it ran and for how long. Nothing is
+ * timed or counted while disabled (the default), so a disabled H5IOStats
+ * costs a branch per phase. Counters are atomic, so they may be read while
+ * another thread records.
+ */
+class H5IOStats
+{
+public:
+  enum phase {file_open, group_create, dataset_create, extent_change,
+    hyperslab_select, pack, compression, conversion, downsample, statistics, write, read, num_phases};
+
+  /**
+   * @brief Times the enclosing scope as one call of a phase
+   */
+  class Timer
+  {
+  private:
+    H5IOStats *stats;
+    int timed_phase;
+    std::chrono::steady_clock::time_point start;
+
+  public:
+    Timer(H5IOStats &stats_in, int phase_in)
+    : stats(stats_in.enabled ? &stats_in : NULL), timed_phase(phase_in)
+    {
+      if(stats)
+        start = std::chrono::steady_clock::now();
+    }
+
+    ~Timer()
+    {
+      if(stats)
+        stats->add(timed_phase, std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start).count());
+    }
+  };
+
+private:
+  bool enabled;
+
+  std::atomic<unsigned long long> calls[num_phases],
+                                  nanoseconds[num_phases],
+                                  bytes_written,
+                                  bytes_read;
+
+public:
+  H5IOStats();
+
+  H5IOStats(const H5IOStats &) = delete;
+
+  H5IOStats & operator=(const H5IOStats &) = delete;
+
+  void setEnabled(bool enabled_in);
+
+  bool isEnabled() const { return enabled; }
+
+  void add(int phase_in, unsigned long long nanoseconds_in);
+
+  void addBytesWritten(size_t bytes);
+
+  void addBytesRead(size_t bytes);
+
+  void accumulate(const H5IOStats &other);
+
+  void reset();
+
+  unsigned long long getCalls(int phase_in) const;
+
+  double getSeconds(int phase_in) const;
+
+  unsigned long long getBytesWritten() const;
+
+  unsigned long long getBytesRead() const;
+
+  static const char * getPhaseName(int phase_in);
+
+  std::string toJSON() const;
+};
+
+#endif
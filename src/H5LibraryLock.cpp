@@ -0,0 +1,51 @@
+#include <hdf5.h>
+#include <mutex>
+#include "H5LibraryLock.h"
+
+#ifdef H5IO_LIBRARY_LOCK
+H5LibraryLock::H5LibraryLock()
+: lock(_getMutex()) { }
+
+std::recursive_mutex & H5LibraryLock::_getMutex()
+{
+  static std::recursive_mutex mutex;
+  return mutex;
+}
+
+/**
+ * @brief Let other threads into HDF5 before going out of scope
+ * @details For calls that wait on threads which use HDF5 themselves.
+ */
+void H5LibraryLock::unlock()
+{
+  lock.unlock();
+}
+#else
+H5LibraryLock::H5LibraryLock() { }
+
+void H5LibraryLock::unlock() { }
+#endif
+
+/**
+ * @brief Check if HDF5 was built thread safe, in which case nothing is locked
+ */
+bool H5LibraryLock::isLibraryThreadSafe()
+{
+#ifdef H5_HAVE_THREADSAFE
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Check if H5LibraryLock locks anything in this build
+ */
+bool H5LibraryLock::isLocking()
+{
+#ifdef H5IO_LIBRARY_LOCK
+  return true;
+#else
+  return false;
+#endif
+}
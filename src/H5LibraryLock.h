@@ -0,0 +1,49 @@
+#ifndef H5LibraryLock_h
+#define H5LibraryLock_h
+
+#include <hdf5.h>
+#include <mutex>
+
+// lock even with a thread safe HDF5, eg. to test the locking itself
+#if !defined(H5_HAVE_THREADSAFE) || defined(H5IO_FORCE_LIBRARY_LOCK)
+#define H5IO_LIBRARY_LOCK
+#endif
+
+/**
+ * @brief Keeps other threads out of HDF5 while in scope, if HDF5 needs it
+ * @details HDF5 built with thread safety (H5_HAVE_THREADSAFE, eg. Debian's
+ * serial packages) serializes its API calls itself and keeps error stacks
+ * per thread, so this lock does nothing there. Other builds must never be
+ * entered by two threads at once; there, every H5IO call that uses HDF5
+ * holds one process-wide recursive mutex for its duration. Work done on
+ * H5IO's thread pools (compression, conversion, packing, downsampling)
+ * never calls HDF5, so it runs outside HDF5's lock in thread safe builds.
+ *
+ * Code calling HDF5 directly alongside H5IO in a build without thread
+ * safety should hold an H5LibraryLock as well. Defining
+ * H5IO_FORCE_LIBRARY_LOCK turns the lock on in thread safe builds too.
+ */
+class H5LibraryLock
+{
+private:
+#ifdef H5IO_LIBRARY_LOCK
+  std::unique_lock<std::recursive_mutex> lock;
+
+  static std::recursive_mutex & _getMutex();
+#endif
+
+public:
+  H5LibraryLock();
+
+  H5LibraryLock(const H5LibraryLock &) = delete;
+
+  H5LibraryLock & operator=(const H5LibraryLock &) = delete;
+
+  void unlock();
+
+  static bool isLibraryThreadSafe();
+
+  static bool isLocking();
+};
+
+#endif
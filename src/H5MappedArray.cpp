@@ -0,0 +1,176 @@
+#include <hdf5.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include "H5LibraryLock.h"
+#include "H5MappedArray.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define H5IO_HAVE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+H5MappedArray::H5MappedArray()
+: map_base(NULL), map_bytes(0), data(NULL), type(-1) { }
+
+H5MappedArray::H5MappedArray(H5MappedArray &&other)
+: map_base(NULL), map_bytes(0), data(NULL), type(-1)
+{
+  *this = std::move(other);
+}
+
+H5MappedArray & H5MappedArray::operator=(H5MappedArray &&other)
+{
+  if(this != &other)
+  {
+    release();
+    map_base = other.map_base;
+    map_bytes = other.map_bytes;
+    buffer.swap(other.buffer); // keeps other.data valid
+    data = other.data;
+    dims.swap(other.dims);
+    type = other.type;
+
+    other.map_base = NULL;
+    other.map_bytes = 0;
+    other.data = NULL;
+    other.type = -1;
+  }
+  return *this;
+}
+
+H5MappedArray::~H5MappedArray()
+{
+  release();
+}
+
+/**
+ * @brief Set dimensions and type of the view
+ * @details The view takes ownership of type_in.
+ */
+void H5MappedArray::setShape(std::vector<hsize_t> &dims_in, hid_t type_in)
+{
+  if(type >= 0)
+    H5Tclose(type);
+  dims = dims_in;
+  type = type_in;
+}
+
+/**
+ * @brief Map bytes of a file starting at offset
+ *
+ * @param file_name file to map
+ * @param offset byte offset of the data in the file
+ * @param bytes number of bytes to map
+ *
+ * @return true if the data was mapped
+ */
+bool H5MappedArray::map(std::string file_name, haddr_t offset, size_t bytes)
+{
+#ifdef H5IO_HAVE_MMAP
+  if(bytes == 0)
+    return false;
+
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if(fd < 0)
+    return false;
+
+  // mappings must start on a page boundary
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t skip = offset % page;
+  void *base = mmap(NULL, bytes + skip, PROT_READ, MAP_SHARED, fd, offset - skip);
+  close(fd);
+  if(base == MAP_FAILED)
+    return false;
+
+  if(map_base != NULL)
+    munmap(map_base, map_bytes);
+  map_base = base;
+  map_bytes = bytes + skip;
+  data = (char *) base + skip;
+  buffer.clear();
+  return true;
+#else
+  (void) file_name;
+  (void) offset;
+  (void) bytes;
+  return false;
+#endif
+}
+
+/**
+ * @brief Get a buffer for data that is read instead of mapped
+ */
+void * H5MappedArray::allocate(size_t bytes)
+{
+#ifdef H5IO_HAVE_MMAP
+  if(map_base != NULL)
+    munmap(map_base, map_bytes);
+#endif
+  map_base = NULL;
+  map_bytes = 0;
+  buffer.resize(bytes);
+  data = (bytes > 0 ? &buffer[0] : NULL);
+  return (void *) data;
+}
+
+/**
+ * @brief Unmap or free the data
+ */
+void H5MappedArray::release()
+{
+#ifdef H5IO_HAVE_MMAP
+  if(map_base != NULL)
+    munmap(map_base, map_bytes);
+#endif
+  map_base = NULL;
+  map_bytes = 0;
+  data = NULL;
+  std::vector<char>().swap(buffer);
+  dims.clear();
+  if(type >= 0)
+  {
+    H5LibraryLock library_lock;
+    H5Tclose(type);
+  }
+  type = -1;
+}
+
+bool H5MappedArray::isMapped() const
+{
+  return map_base != NULL;
+}
+
+const void * H5MappedArray::getData() const
+{
+  return data;
+}
+
+int H5MappedArray::getRank() const
+{
+  return dims.size();
+}
+
+const std::vector<hsize_t> & H5MappedArray::getDims() const
+{
+  return dims;
+}
+
+hsize_t H5MappedArray::getNumElements() const
+{
+  hsize_t n = 1;
+  for(size_t i = 0; i < dims.size(); ++i)
+    n *= dims[i];
+  return n;
+}
+
+/**
+ * @brief Get the memory type of the data
+ * @details Owned by the view; valid until it is released.
+ */
+hid_t H5MappedArray::getType() const
+{
+  return type;
+}
@@ -0,0 +1,67 @@
+#ifndef H5MappedArray_h
+#define H5MappedArray_h
+
+#include <hdf5.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Read-only view of a whole dataset
+ * @details Filled by H5IO::mapArrayFromFile. Contiguous, unfiltered datasets
+ * stored in the native type are mapped straight from the file, so pages are
+ * only read when touched and nothing is copied. Any other dataset is read
+ * into a buffer owned by the view. Either way getData() points to the
+ * dataset in row-major order, in the type returned by getType().
+ *
+ * A mapping stays valid after the file is closed, but shows later writes to
+ * the dataset; don't rewrite a dataset while it is mapped.
+ */
+class H5MappedArray
+{
+private:
+  void *map_base; //start of the mapping, page aligned
+  size_t map_bytes;
+
+  const void *data;
+
+  std::vector<char> buffer; //data of datasets that can't be mapped
+
+  std::vector<hsize_t> dims;
+
+  hid_t type;
+
+public:
+  H5MappedArray();
+
+  H5MappedArray(const H5MappedArray &) = delete;
+
+  H5MappedArray & operator=(const H5MappedArray &) = delete;
+
+  H5MappedArray(H5MappedArray &&other);
+
+  H5MappedArray & operator=(H5MappedArray &&other);
+
+  ~H5MappedArray();
+
+  void setShape(std::vector<hsize_t> &dims_in, hid_t type_in);
+
+  bool map(std::string file_name, haddr_t offset, size_t bytes);
+
+  void * allocate(size_t bytes);
+
+  void release();
+
+  bool isMapped() const;
+
+  const void * getData() const;
+
+  int getRank() const;
+
+  const std::vector<hsize_t> & getDims() const;
+
+  hsize_t getNumElements() const;
+
+  hid_t getType() const;
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include <hdf5.h>
+#include <cstring>
+#include "H5SizeArray.h"
+#include "H5SParams.h"
+#include "H5Pack.h"
+
+namespace
+{
+
+struct H5PackSelection
+{
+  int rank;
+
+  hsize_t start[H5S_MAX_RANK],
+          stride[H5S_MAX_RANK],
+          count[H5S_MAX_RANK],
+          block[H5S_MAX_RANK],
+          row_elements[H5S_MAX_RANK]; //elements between neighbours in each dimension
+};
+
+/**
+ * @brief Copy the selected elements of one row (last dimension)
+ * @details SIZE is the element size; copies of SIZE bytes compile to single
+ * moves.
+ */
+template<size_t SIZE, bool GATHER>
+inline void _copyRow(char *row, char *&packed, const H5PackSelection &sel)
+{
+  const int d = sel.rank - 1;
+  char *first = row + sel.start[d] * SIZE;
+  hsize_t count = sel.count[d], stride = sel.stride[d], block = sel.block[d];
+
+  if(count == 1 || stride == block)
+  {
+    // one contiguous run
+    size_t bytes = ((count - 1) * stride + block) * SIZE;
+    if(GATHER)
+      std::memcpy(packed, first, bytes);
+    else
+      std::memcpy(first, packed, bytes);
+    packed += bytes;
+  }
+  else if(block == 1)
+  {
+    for(hsize_t c = 0; c < count; ++c)
+      if(GATHER)
+        std::memcpy(packed + c * SIZE, first + c * stride * SIZE, SIZE);
+      else
+        std::memcpy(first + c * stride * SIZE, packed + c * SIZE, SIZE);
+    packed += count * SIZE;
+  }
+  else
+  {
+    for(hsize_t c = 0; c < count; ++c)
+    {
+      if(GATHER)
+        std::memcpy(packed, first + c * stride * SIZE, block * SIZE);
+      else
+        std::memcpy(first + c * stride * SIZE, packed, block * SIZE);
+      packed += block * SIZE;
+    }
+  }
+}
+
+/**
+ * @brief Copy loops for a fixed rank; LEFT dimensions remain
+ */
+template<size_t SIZE, bool GATHER, int RANK, int LEFT>
+struct H5PackKernel
+{
+  static void run(char *array, char *&packed, const H5PackSelection &sel)
+  {
+    const int d = RANK - LEFT;
+    for(hsize_t c = 0; c < sel.count[d]; ++c)
+      for(hsize_t b = 0; b < sel.block[d]; ++b)
+        H5PackKernel<SIZE, GATHER, RANK, LEFT - 1>::run(
+          array + (sel.start[d] + c * sel.stride[d] + b) * sel.row_elements[d] * SIZE, packed, sel);
+  }
+};
+
+template<size_t SIZE, bool GATHER, int RANK>
+struct H5PackKernel<SIZE, GATHER, RANK, 1>
+{
+  static void run(char *array, char *&packed, const H5PackSelection &sel)
+  {
+    _copyRow<SIZE, GATHER>(array, packed, sel);
+  }
+};
+
+/**
+ * @brief Copy loop for any rank, stepping through rows like an odometer
+ */
+template<size_t SIZE, bool GATHER>
+void _copyAnyRank(char *array, char *packed, const H5PackSelection &sel)
+{
+  int outer = sel.rank - 1;
+  hsize_t pos[H5S_MAX_RANK] = {0};
+  hsize_t rows = 1;
+  for(int i = 0; i < outer; ++i)
+    rows *= sel.count[i] * sel.block[i];
+
+  for(hsize_t r = 0; r < rows; ++r)
+  {
+    hsize_t offset = 0;
+    for(int i = 0; i < outer; ++i)
+      offset += (sel.start[i] + pos[i] / sel.block[i] * sel.stride[i] + pos[i] % sel.block[i]) * sel.row_elements[i];
+    _copyRow<SIZE, GATHER>(array + offset * SIZE, packed, sel);
+
+    for(int i = outer - 1; i >= 0; --i)
+    {
+      if(++pos[i] < sel.count[i] * sel.block[i])
+        break;
+      pos[i] = 0;
+    }
+  }
+}
+
+template<size_t SIZE, bool GATHER>
+void _copy(char *array, char *packed, const H5PackSelection &sel)
+{
+  switch(sel.rank)
+  {
+    case 1:
+      H5PackKernel<SIZE, GATHER, 1, 1>::run(array, packed, sel);
+      break;
+    case 2:
+      H5PackKernel<SIZE, GATHER, 2, 2>::run(array, packed, sel);
+      break;
+    case 3:
+      H5PackKernel<SIZE, GATHER, 3, 3>::run(array, packed, sel);
+      break;
+    default:
+      _copyAnyRank<SIZE, GATHER>(array, packed, sel);
+  }
+}
+
+template<bool GATHER>
+bool _copyBySize(size_t type_size, char *array, char *packed, const H5PackSelection &sel)
+{
+  switch(type_size)
+  {
+    case 1: _copy<1, GATHER>(array, packed, sel); return true;
+    case 2: _copy<2, GATHER>(array, packed, sel); return true;
+    case 4: _copy<4, GATHER>(array, packed, sel); return true;
+    case 8: _copy<8, GATHER>(array, packed, sel); return true;
+    case 16: _copy<16, GATHER>(array, packed, sel); return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Get a selection from selection params, if the kernels handle it
+ * @details Overlapping blocks and selections outside the array are left to
+ * HDF5.
+ */
+bool _getSelection(H5SParams &params, size_t type_size, H5PackSelection &sel)
+{
+  if(type_size != 1 && type_size != 2 && type_size != 4 && type_size != 8 && type_size != 16)
+    return false;
+
+  sel.rank = params.getRank();
+  if(sel.rank < 1 || sel.rank > H5S_MAX_RANK)
+    return false;
+
+  hsize_t elements = 1;
+  for(int i = sel.rank - 1; i >= 0; --i)
+  {
+    sel.start[i] = params.start[i];
+    sel.stride[i] = params.stride[i];
+    sel.count[i] = params.count[i];
+    sel.block[i] = params.block[i];
+    sel.row_elements[i] = elements;
+    elements *= params.dims[i];
+
+    if(sel.count[i] < 1 || sel.block[i] < 1 || sel.stride[i] < 1)
+      return false;
+    if(sel.count[i] > 1 && sel.block[i] > sel.stride[i])
+      return false;
+    if(sel.start[i] + (sel.count[i] - 1) * sel.stride[i] + sel.block[i] > params.dims[i])
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+/**
+ * @brief Check if gather and scatter can handle a selection
+ *
+ * @param selection dims, start, stride, count and block of the selection
+ * @param type_size size of one element in bytes
+ */
+bool H5Pack::supported(H5SParams &selection, size_t type_size)
+{
+  H5PackSelection sel;
+  return _getSelection(selection, type_size, sel);
+}
+
+/**
+ * @brief Copy the selected elements of array into packed
+ *
+ * @param selection dims, start, stride, count and block of the selection
+ * @param type_size size of one element in bytes
+ * @param array array with dimensions selection.dims
+ * @param packed buffer for all selected elements
+ *
+ * @return false if the selection is not supported; nothing is copied then
+ */
+bool H5Pack::gather(H5SParams &selection, size_t type_size, const void *array, void *packed)
+{
+  H5PackSelection sel;
+  if(!_getSelection(selection, type_size, sel))
+    return false;
+  return _copyBySize<true>(type_size, (char *) array, (char *) packed, sel);
+}
+
+/**
+ * @brief Copy packed elements into the selected elements of array
+ * @details Inverse of gather.
+ */
+bool H5Pack::scatter(H5SParams &selection, size_t type_size, const void *packed, void *array)
+{
+  H5PackSelection sel;
+  if(!_getSelection(selection, type_size, sel))
+    return false;
+  return _copyBySize<false>(type_size, (char *) array, (char *) packed, sel);
+}
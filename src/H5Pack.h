@@ -0,0 +1,28 @@
+#ifndef H5Pack_h
+#define H5Pack_h
+
+#include <hdf5.h>
+#include <cstddef>
+#include "H5SParams.h"
+
+/**
+ * @brief Copy hyperslab selections of in-memory arrays to and from
+ * contiguous buffers
+ * @details Does what H5Dgather and H5Dscatter do for a regular hyperslab
+ * (start, stride, count, block) of a row-major array, without HDF5's
+ * generic selection iterator. The copy loops are instantiated per element
+ * size and for ranks 1 to 3; other ranks use a generic loop over rows.
+ * Elements are packed in the order HDF5 uses, so the packed buffer can be
+ * written with a contiguous memory dataspace.
+ */
+class H5Pack
+{
+public:
+  static bool supported(H5SParams &selection, size_t type_size);
+
+  static bool gather(H5SParams &selection, size_t type_size, const void *array, void *packed);
+
+  static bool scatter(H5SParams &selection, size_t type_size, const void *packed, void *array);
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include <hdf5.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <stdint.h>
+#include "H5ThreadPool.h"
+#include "H5Pyramid.h"
+
+namespace
+{
+
+enum kind {other, single, twice, int32, int64};
+
+const hsize_t H5PYRAMID_BLOCK = 1 << 16; //output elements per task
+
+int _getKind(hid_t type)
+{
+  if(H5Tequal(type, H5T_NATIVE_FLOAT) > 0)
+    return single;
+  if(H5Tequal(type, H5T_NATIVE_DOUBLE) > 0)
+    return twice;
+  if(H5Tequal(type, H5T_NATIVE_INT32) > 0)
+    return int32;
+  if(H5Tequal(type, H5T_NATIVE_INT64) > 0)
+    return int64;
+  return other;
+}
+
+/**
+ * @brief Dimensions of a downsampling, as rows along the last dimension
+ */
+struct H5PyramidShape
+{
+  int rank;
+  hsize_t dims[H5Pyramid::max_rank],
+          level_dims[H5Pyramid::max_rank],
+          row_strides[H5Pyramid::max_rank]; //input rows between neighbours in each dimension
+  hsize_t rows; //output rows
+
+  H5PyramidShape(int rank_in, const hsize_t *dims_in)
+  : rank(rank_in), rows(1)
+  {
+    H5Pyramid::getLevelDims(rank, dims_in, level_dims);
+    hsize_t stride = 1;
+    for(int k = rank - 1; k >= 0; --k)
+    {
+      dims[k] = dims_in[k];
+      if(k < rank - 1)
+      {
+        row_strides[k] = stride;
+        stride *= dims[k];
+        rows *= level_dims[k];
+      }
+    }
+  }
+
+  hsize_t getLength() const { return dims[rank - 1]; }
+
+  hsize_t getLevelLength() const { return level_dims[rank - 1]; }
+
+  /**
+   * @brief Find the input rows covered by an output row
+   * @details The first is the one decimation keeps.
+   *
+   * @param inputs space for 2^(rank - 1) row numbers
+   * @return number of input rows
+   */
+  int getInputRows(hsize_t row, hsize_t *inputs) const
+  {
+    hsize_t coords[H5Pyramid::max_rank];
+    for(int k = rank - 2; k >= 0; --k)
+    {
+      coords[k] = row % level_dims[k];
+      row /= level_dims[k];
+    }
+
+    int n = 1;
+    inputs[0] = 0;
+    for(int k = 0; k < rank - 1; ++k)
+    {
+      hsize_t first = 2 * coords[k];
+      bool pair = first + 1 < dims[k];
+      for(int i = 0; i < n; ++i)
+      {
+        if(pair)
+          inputs[n + i] = inputs[i] + (first + 1) * row_strides[k];
+        inputs[i] += first * row_strides[k];
+      }
+      if(pair)
+        n *= 2;
+    }
+    return n;
+  }
+};
+
+/**
+ * @brief Average output rows first to last, summing in A
+ */
+template<typename T, typename A>
+void _meanRows(const H5PyramidShape &shape, const T *src, T *dst, hsize_t first, hsize_t last)
+{
+  hsize_t length = shape.getLength(),
+          level_length = shape.getLevelLength(),
+          pairs = length / 2;
+  std::vector<A> sums(level_length);
+  std::vector<hsize_t> inputs((size_t) 1 << (shape.rank - 1));
+
+  for(hsize_t row = first; row < last; ++row)
+  {
+    int n = shape.getInputRows(row, &inputs[0]);
+    std::fill(sums.begin(), sums.end(), A(0));
+    for(int i = 0; i < n; ++i)
+    {
+      const T *in = src + inputs[i] * length;
+      for(hsize_t j = 0; j < pairs; ++j)
+        sums[j] += static_cast<A>(in[2 * j]) + static_cast<A>(in[2 * j + 1]);
+      if(length % 2)
+        sums[pairs] += static_cast<A>(in[length - 1]);
+    }
+
+    T *out = dst + row * level_length;
+    A count = static_cast<A>(2 * n);
+    for(hsize_t j = 0; j < pairs; ++j)
+      out[j] = static_cast<T>(sums[j] / count);
+    if(length % 2)
+      out[pairs] = static_cast<T>(sums[pairs] / static_cast<A>(n));
+  }
+}
+
+/**
+ * @brief Keep every other element of output rows first to last
+ */
+template<typename T>
+void _decimateRows(const H5PyramidShape &shape, const T *src, T *dst, hsize_t first, hsize_t last)
+{
+  hsize_t length = shape.getLength(),
+          level_length = shape.getLevelLength();
+  std::vector<hsize_t> inputs((size_t) 1 << (shape.rank - 1));
+
+  for(hsize_t row = first; row < last; ++row)
+  {
+    shape.getInputRows(row, &inputs[0]);
+    const T *in = src + inputs[0] * length;
+    T *out = dst + row * level_length;
+    for(hsize_t j = 0; j < level_length; ++j)
+      out[j] = in[2 * j];
+  }
+}
+
+/**
+ * @brief Decimate elements of any size
+ */
+void _decimateBytes(const H5PyramidShape &shape, size_t type_size, const char *src, char *dst, hsize_t first, hsize_t last)
+{
+  hsize_t length = shape.getLength(),
+          level_length = shape.getLevelLength();
+  std::vector<hsize_t> inputs((size_t) 1 << (shape.rank - 1));
+
+  for(hsize_t row = first; row < last; ++row)
+  {
+    shape.getInputRows(row, &inputs[0]);
+    const char *in = src + inputs[0] * length * type_size;
+    char *out = dst + row * level_length * type_size;
+    for(hsize_t j = 0; j < level_length; ++j)
+      std::memcpy(out + j * type_size, in + 2 * j * type_size, type_size);
+  }
+}
+
+/**
+ * @brief Run rows(first, last) over all output rows in blocks on the pool
+ */
+void _forRows(const H5PyramidShape &shape, H5ThreadPool &pool, const std::function<void(hsize_t, hsize_t)> &rows)
+{
+  hsize_t rows_per_task = std::max<hsize_t>(1, H5PYRAMID_BLOCK / shape.getLevelLength()),
+          tasks = (shape.rows + rows_per_task - 1) / rows_per_task;
+  if(tasks <= 1 || pool.getThreads() <= 1)
+  {
+    rows(0, shape.rows);
+    return;
+  }
+
+  pool.parallelFor(tasks, [&](size_t t) {
+    hsize_t first = t * rows_per_task;
+    rows(first, std::min(shape.rows, first + rows_per_task));
+  });
+}
+
+template<typename T, typename A>
+void _mean(const H5PyramidShape &shape, const void *src, void *dst, H5ThreadPool &pool)
+{
+  const T *typed_src = static_cast<const T *>(src);
+  T *typed_dst = static_cast<T *>(dst);
+  _forRows(shape, pool, [&](hsize_t first, hsize_t last) {
+    _meanRows<T, A>(shape, typed_src, typed_dst, first, last);
+  });
+}
+
+template<typename T>
+void _decimate(const H5PyramidShape &shape, const void *src, void *dst, H5ThreadPool &pool)
+{
+  const T *typed_src = static_cast<const T *>(src);
+  T *typed_dst = static_cast<T *>(dst);
+  _forRows(shape, pool, [&](hsize_t first, hsize_t last) {
+    _decimateRows<T>(shape, typed_src, typed_dst, first, last);
+  });
+}
+
+} // namespace
+
+/**
+ * @brief Check if downsample handles a type, method and rank
+ */
+bool H5Pyramid::supported(hid_t type, int method_in, int rank)
+{
+  if(rank < 1 || rank > max_rank)
+    return false;
+  if(method_in == decimate)
+    return H5Tget_size(type) > 0;
+  return method_in == mean && _getKind(type) != other;
+}
+
+/**
+ * @brief Get the dimensions of the next level: dims halved, rounding up
+ */
+void H5Pyramid::getLevelDims(int rank, const hsize_t *dims, hsize_t *level_dims)
+{
+  for(int k = 0; k < rank; ++k)
+    level_dims[k] = (dims[k] + 1) / 2;
+}
+
+/**
+ * @brief Get the name of a level of a dataset's pyramid
+ *
+ * @param level 1 for the 2x coarser level, 2 for 4x...
+ */
+std::string H5Pyramid::getLevelName(std::string dset_name, int level)
+{
+  return dset_name + "_pyramid/x" + std::to_string(1ULL << level);
+}
+
+/**
+ * @brief Downsample a contiguous array by 2 in every dimension
+ *
+ * @param type native type of the elements
+ * @param method_in one of enum method
+ * @param dims dimensions of src
+ * @param src array to downsample
+ * @param dst space for the array of getLevelDims(dims)
+ * @param pool threads to downsample on
+ *
+ * @return false if the type, method or rank is not supported
+ */
+bool H5Pyramid::downsample(hid_t type, int method_in, int rank, const hsize_t *dims,
+  const void *src, void *dst, H5ThreadPool &pool)
+{
+  if(!supported(type, method_in, rank))
+    return false;
+
+  H5PyramidShape shape(rank, dims);
+  if(method_in == mean)
+  {
+    int type_kind = _getKind(type);
+    if(type_kind == single)
+      _mean<float, float>(shape, src, dst, pool);
+    else if(type_kind == twice)
+      _mean<double, double>(shape, src, dst, pool);
+    else if(type_kind == int32)
+      _mean<int32_t, int64_t>(shape, src, dst, pool);
+    else
+      _mean<int64_t, int64_t>(shape, src, dst, pool);
+    return true;
+  }
+
+  size_t type_size = H5Tget_size(type);
+  if(type_size == 1)
+    _decimate<uint8_t>(shape, src, dst, pool);
+  else if(type_size == 2)
+    _decimate<uint16_t>(shape, src, dst, pool);
+  else if(type_size == 4)
+    _decimate<uint32_t>(shape, src, dst, pool);
+  else if(type_size == 8)
+    _decimate<uint64_t>(shape, src, dst, pool);
+  else
+    _forRows(shape, pool, [&](hsize_t first, hsize_t last) {
+      _decimateBytes(shape, type_size, static_cast<const char *>(src), static_cast<char *>(dst), first, last);
+    });
+  return true;
+}
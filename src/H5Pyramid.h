@@ -0,0 +1,41 @@
+#ifndef H5Pyramid_h
+#define H5Pyramid_h
+
+#include <hdf5.h>
+#include <string>
+#include "H5ThreadPool.h"
+
+/**
+ * @brief Downsampling of arrays by 2 in every dimension on a thread pool
+ * @details Each level of a pyramid halves every dimension of the one
+ * before it, rounding up; level k is 2^k times coarser than the array.
+ * Elements are either the mean of the (up to 2^rank) elements they cover
+ * or the first of those elements (decimation). Means are available for
+ * native floats, doubles, int32s and int64s (integer means round toward
+ * zero); decimation for any type.
+ *
+ * Rows of the output are split across the threads of a pool, and the
+ * innermost loops are plain loops over a row the compiler can vectorize.
+ *
+ * Levels of a dataset "name" are stored as "name_pyramid/x2",
+ * "name_pyramid/x4"... (see getLevelName), each with an integer "scale"
+ * attribute holding its factor.
+ */
+class H5Pyramid
+{
+public:
+  enum method {mean, decimate};
+
+  static const int max_rank = 8;
+
+  static bool supported(hid_t type, int method_in, int rank);
+
+  static void getLevelDims(int rank, const hsize_t *dims, hsize_t *level_dims);
+
+  static std::string getLevelName(std::string dset_name, int level);
+
+  static bool downsample(hid_t type, int method_in, int rank, const hsize_t *dims,
+    const void *src, void *dst, H5ThreadPool &pool);
+};
+
+#endif
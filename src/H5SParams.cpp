@@ -3,10 +3,10 @@
 #include "H5SParams.h"
 
 H5SParams::H5SParams()
-: dims(1), maxdims(1), start(1), stride(1), count(1), block(1), chunk(1) { }
+: id(-1), dims(1), maxdims(1), start(1), stride(1), count(1), block(1), chunk(1) { }
 
 H5SParams::H5SParams(int rank_in)
-: dims(rank_in), maxdims(rank_in), start(rank_in), stride(rank_in), count(rank_in), block(rank_in), chunk(rank_in)
+: id(-1), dims(rank_in), maxdims(rank_in), start(rank_in), stride(rank_in), count(rank_in), block(rank_in), chunk(rank_in)
 {
   rank=rank_in;
 }
@@ -51,7 +51,8 @@ void H5SParams::setCount()
 void H5SParams::setDefaults(int rank_in, H5SizeArray &dims_in)
 {
   setRank(rank_in);
-  dims = dims_in;
+  for(int i = 0; i < rank; ++i)
+    dims[i] = dims_in[i];
   maxdims = dims;
   block.setValues(1);
   start.setValues(0);
@@ -70,10 +71,18 @@ void H5SParams::createSpace()
   id = H5Screate_simple(rank, dims.getPtr(), maxdims.getPtr());
 }
 
+/**
+ * @brief Close the dataspace, if there is one open
+ */
 herr_t H5SParams::closeSpace()
 {
-  return H5Sclose(id);
+  if(id < 0)
+    return 0;
+  herr_t status = H5Sclose(id);
+  id = -1;
+  return status;
 }
+
 /**
  * @brief Sets a hyperslab assuming everything is defined (except count)
  * @details This assumes that id, start, stride, and block have been defined.
@@ -87,3 +96,82 @@ void H5SParams::setHyperslab()
   //seting hyperslab
   H5Sselect_hyperslab(id, H5S_SELECT_SET, start.getPtr(), stride.getPtr(), count.getPtr(), block.getPtr());
 }
+
+/**
+ * @brief Select start, stride, count and block in another dataspace
+ * @details Unlike setHyperslab, count is used as it is.
+ *
+ * @param space_id dataspace of the same rank
+ */
+herr_t H5SParams::selectHyperslab(hid_t space_id)
+{
+  return H5Sselect_hyperslab(space_id, H5S_SELECT_SET, start.getPtr(), stride.getPtr(), count.getPtr(), block.getPtr());
+}
+
+/**
+ * @brief Halve chunk extents until a chunk fits in target_bytes
+ * @details The largest extent is halved each time; ties go to the slowest
+ * varying dimension so that chunks keep long contiguous rows.
+ */
+void H5SParams::_shrinkChunk(size_t type_size, size_t target_bytes)
+{
+  while(getChunkBytes(type_size) > target_bytes)
+  {
+    int largest = 0;
+    for(int i = 1; i < rank; ++i)
+      if(chunk[i] > chunk[largest])
+        largest = i;
+
+    if(chunk[largest] <= 1)
+      break;
+    chunk[largest] = (chunk[largest] + 1) / 2;
+  }
+}
+
+/**
+ * @brief Choose chunk dimensions of roughly target_bytes
+ * @details Starts from the full dataset dimensions and shrinks them.
+ *
+ * @param type_size size of one element in bytes
+ * @param target_bytes largest wanted chunk size in bytes
+ */
+void H5SParams::guessChunk(size_t type_size, size_t target_bytes)
+{
+  for(int i = 0; i < rank; ++i)
+    chunk[i] = (dims[i] > 0 ? dims[i] : 1);
+
+  _shrinkChunk(type_size, target_bytes);
+}
+
+/**
+ * @brief Choose chunk dimensions of roughly target_bytes that line up with
+ * an access pattern
+ * @details Chunks are first limited to access_in, the extent of a typical
+ * hyperslab that will be read or written (0 leaves a dimension
+ * unrestricted), and then shrunk further if needed. For example,
+ * access_in = (1, N, N) for z-slices of an N^3 grid gives chunks that hold
+ * only (parts of) a single slice, so reading a slice touches no other data.
+ *
+ * @param type_size size of one element in bytes
+ * @param target_bytes largest wanted chunk size in bytes
+ * @param access_in typical hyperslab extent
+ */
+void H5SParams::guessChunk(size_t type_size, size_t target_bytes, H5SizeArray &access_in)
+{
+  for(int i = 0; i < rank; ++i)
+  {
+    chunk[i] = (dims[i] > 0 ? dims[i] : 1);
+    if(i < access_in.getRank() && access_in[i] > 0 && access_in[i] < chunk[i])
+      chunk[i] = access_in[i];
+  }
+
+  _shrinkChunk(type_size, target_bytes);
+}
+
+size_t H5SParams::getChunkBytes(size_t type_size)
+{
+  size_t bytes = type_size;
+  for(int i = 0; i < rank; ++i)
+    bytes *= chunk[i];
+  return bytes;
+}
@@ -10,6 +10,8 @@ private:
   int rank,
       verbosity_level;
 
+  void _shrinkChunk(size_t type_size, size_t target_bytes);
+
 public:
   hid_t type,
         id;
@@ -44,6 +46,14 @@ public:
 
   void setHyperslab();
 
+  herr_t selectHyperslab(hid_t space_id);
+
+  void guessChunk(size_t type_size, size_t target_bytes);
+
+  void guessChunk(size_t type_size, size_t target_bytes, H5SizeArray &access_in);
+
+  size_t getChunkBytes(size_t type_size);
+
 };
 
 #endif
\ No newline at end of file
@@ -1,24 +1,28 @@
 #include <hdf5.h>
 #include <iostream>
-#include <cstdarg>
+#include <initializer_list>
 #include "H5SizeArray.h"
 
-H5SizeArray::H5SizeArray(int rank_in, ...)
+H5SizeArray::H5SizeArray()
+: rank(0)
 {
-  rank = rank_in;
-  array = new hsize_t[rank];
-  va_list args;
-  va_start(args, rank_in);
-  for(int i=0; i<rank; ++i)
-  {
-    array[i] = (hsize_t) va_arg(args, int);
-  }
-  va_end(args);
+  for(int i = 0; i < H5S_MAX_RANK; ++i)
+    array[i] = 0;
+}
+
+H5SizeArray::H5SizeArray(std::initializer_list<hsize_t> values_in)
+: rank(_clampRank(values_in.size()))
+{
+  const hsize_t *value = values_in.begin();
+  for(int i = 0; i < H5S_MAX_RANK; ++i)
+    array[i] = (i < rank ? value[i] : 0);
 }
 
-H5SizeArray::~H5SizeArray()
+int H5SizeArray::_clampRank(int rank_in)
 {
-  delete[] array;
+  if(rank_in < 0)
+    return 0;
+  return (rank_in > H5S_MAX_RANK ? H5S_MAX_RANK : rank_in);
 }
 
 hsize_t* H5SizeArray::getPtr()
@@ -26,7 +30,12 @@ hsize_t* H5SizeArray::getPtr()
   return array;
 }
 
-int H5SizeArray::getRank()
+const hsize_t* H5SizeArray::getPtr() const
+{
+  return array;
+}
+
+int H5SizeArray::getRank() const
 {
   return rank;
 }
@@ -36,34 +45,37 @@ hsize_t& H5SizeArray::operator[](int idx)
   return array[idx];
 }
 
-bool H5SizeArray::operator=(H5SizeArray &input)
+const hsize_t& H5SizeArray::operator[](int idx) const
 {
-  int tmp_rank;
-  (input.getRank()< rank ? tmp_rank = input.getRank() : tmp_rank=rank);
-  for( int i = 0; i < tmp_rank; i++)
-    array[i] = input[i];
-
-  return true;
+  return array[idx];
 }
 
+/**
+ * @brief Set all values (up to the rank) to value
+ */
 void H5SizeArray::setValues(hsize_t value)
 {
   for(int i = 0; i < rank; ++i)
     array[i] = value;
 }
 
+/**
+ * @brief Change the rank
+ * @details Values below both ranks are kept; new values are 0.
+ */
 void H5SizeArray::setRank(int rank_in)
 {
-  delete[] array;
-  rank=rank_in;
-  array = new hsize_t[rank];
+  rank_in = _clampRank(rank_in);
+  for(int i = rank; i < rank_in; ++i)
+    array[i] = 0;
+  rank = rank_in;
 }
 
-void H5SizeArray::print()
+void H5SizeArray::print() const
 {
   std::cout << std::endl;
   for(int i=0;i<rank;i++)
     std::cout << array[i] << " ";
 
   std::cout << std::endl << std::flush;
-}
\ No newline at end of file
+}
@@ -2,33 +2,85 @@
 #define H5SizeArray_h
 
 #include <hdf5.h>
+#include <initializer_list>
 
+/**
+ * @brief Small array of dataspace sizes (dimensions, offsets, strides...)
+ * @details Holds up to H5S_MAX_RANK values inline, so creating and copying
+ * one never allocates. Values are full 64-bit hsize_t's:
+ *
+ *   H5SizeArray dims (3, 4096, 4096, 4096); // rank, then values
+ *   H5SizeArray dims = {4096, 4096, 4096};  // rank from number of values
+ *
+ * Values not given are 0.
+ */
 class H5SizeArray
 {
 private:
   int rank;
 
-  hsize_t *array;
+  hsize_t array[H5S_MAX_RANK];
+
+  static int _clampRank(int rank_in);
 
 public:
-  H5SizeArray(int rank_in, ...);
+  H5SizeArray();
+
+  /**
+   * @brief Array of rank_in values, the first of which are given
+   */
+  template<typename... Values>
+  explicit H5SizeArray(int rank_in, Values... values_in)
+  : rank(_clampRank(rank_in))
+  {
+    const hsize_t values[] = {static_cast<hsize_t>(values_in)..., 0};
+    const int n = sizeof...(Values);
+    for(int i = 0; i < H5S_MAX_RANK; ++i)
+      array[i] = (i < n && i < rank ? values[i] : 0);
+  }
 
-  ~H5SizeArray();
+  H5SizeArray(std::initializer_list<hsize_t> values_in);
 
   hsize_t* getPtr();
 
-  int getRank();
+  const hsize_t* getPtr() const;
+
+  int getRank() const;
 
   hsize_t& operator[](int idx);
 
-  bool operator=(H5SizeArray &input);
+  const hsize_t& operator[](int idx) const;
 
   void setValues(hsize_t value);
 
   void setRank(int rank_in);
 
-  void print();
+  void print() const;
 
 };
 
-#endif
\ No newline at end of file
+/**
+ * @brief H5SizeArray with a rank fixed at compile time
+ * @details Can be passed wherever an H5SizeArray is expected.
+ *
+ *   H5SizeArrayN<3> dims (4096, 4096, 4096);
+ */
+template<int N>
+class H5SizeArrayN : public H5SizeArray
+{
+public:
+  static constexpr int static_rank = N;
+
+  template<typename... Values>
+  H5SizeArrayN(Values... values_in)
+  : H5SizeArray(N, values_in...)
+  {
+    static_assert(N >= 0 && N <= H5S_MAX_RANK, "rank must be between 0 and H5S_MAX_RANK");
+    static_assert(sizeof...(Values) <= N, "more values than the rank");
+  }
+};
+
+template<int N>
+constexpr int H5SizeArrayN<N>::static_rank;
+
+#endif
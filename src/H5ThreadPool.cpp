@@ -0,0 +1,119 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include "H5ThreadPool.h"
+
+H5ThreadPool::H5ThreadPool(int threads_in)
+: task(NULL), task_size(0), next_index(0), active_workers(0), generation(0), stopping(false)
+{
+  setThreads(threads_in);
+}
+
+H5ThreadPool::~H5ThreadPool()
+{
+  _stop();
+}
+
+/**
+ * @brief Run loop iterations until none are left
+ */
+void H5ThreadPool::_runTasks()
+{
+  size_t i;
+  while((i = next_index++) < task_size)
+    (*task)(i);
+}
+
+/**
+ * @brief Worker thread main loop
+ *
+ * @param seen_generation generation of work already done when started
+ */
+void H5ThreadPool::_work(unsigned long seen_generation)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true)
+  {
+    work_cv.wait(lock, [&]{ return stopping || generation != seen_generation; });
+    if(stopping)
+      return;
+    seen_generation = generation;
+
+    lock.unlock();
+    _runTasks();
+    lock.lock();
+
+    if(--active_workers == 0)
+      done_cv.notify_all();
+  }
+}
+
+void H5ThreadPool::_stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_cv.notify_all();
+  for(size_t i = 0; i < workers.size(); ++i)
+    workers[i].join();
+  workers.clear();
+  stopping = false;
+}
+
+/**
+ * @brief Set number of threads used, including the calling thread
+ *
+ * @param threads_in number of threads (0 for hardware concurrency)
+ */
+void H5ThreadPool::setThreads(int threads_in)
+{
+  std::lock_guard<std::mutex> call_lock(call_mutex);
+  if(threads_in <= 0)
+    threads_in = std::thread::hardware_concurrency();
+  if(threads_in <= 0)
+    threads_in = 1;
+  if(threads_in == getThreads())
+    return;
+
+  _stop();
+  for(int i = 1; i < threads_in; ++i)
+    workers.push_back(std::thread(&H5ThreadPool::_work, this, generation));
+}
+
+int H5ThreadPool::getThreads()
+{
+  return workers.size() + 1;
+}
+
+/**
+ * @brief Call task_in(i) for i in [0, n) on the pool and wait for all calls
+ * to finish
+ */
+void H5ThreadPool::parallelFor(size_t n, const std::function<void(size_t)> &task_in)
+{
+  std::lock_guard<std::mutex> call_lock(call_mutex);
+  if(n == 0)
+    return;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  task = &task_in;
+  task_size = n;
+  next_index = 0;
+  if(workers.size() > 0 && n > 1)
+  {
+    active_workers = workers.size();
+    generation++;
+    work_cv.notify_all();
+  }
+  lock.unlock();
+
+  _runTasks();
+
+  lock.lock();
+  done_cv.wait(lock, [&]{ return active_workers == 0; });
+  task = NULL;
+}
@@ -0,0 +1,61 @@
+#ifndef H5ThreadPool_h
+#define H5ThreadPool_h
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/**
+ * @brief Small fixed-size pool of worker threads
+ * @details Runs the iterations of a loop concurrently. The calling thread
+ * takes part in the work, so a pool of N threads starts N-1 workers and a
+ * pool of one thread runs everything on the caller.
+ *
+ * Tasks run on the pool must not call HDF5; only one thread should talk to
+ * the library at a time.
+ */
+class H5ThreadPool
+{
+private:
+  std::vector<std::thread> workers;
+
+  std::mutex mutex,
+             call_mutex; //serializes calls to parallelFor
+
+  std::condition_variable work_cv,
+                          done_cv;
+
+  const std::function<void(size_t)> *task;
+
+  size_t task_size;
+
+  std::atomic<size_t> next_index;
+
+  int active_workers;
+
+  unsigned long generation;
+
+  bool stopping;
+
+  void _work(unsigned long seen_generation);
+
+  void _runTasks();
+
+  void _stop();
+
+public:
+  H5ThreadPool(int threads_in);
+
+  ~H5ThreadPool();
+
+  void setThreads(int threads_in);
+
+  int getThreads();
+
+  void parallelFor(size_t n, const std::function<void(size_t)> &task_in);
+};
+
+#endif
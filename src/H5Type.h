@@ -0,0 +1,44 @@
+#ifndef H5Type_h
+#define H5Type_h
+
+#include <hdf5.h>
+
+/**
+ * @brief HDF5 native type of a C++ type
+ * @details Specialized for the arithmetic types HDF5 has native types for;
+ * H5Type<T>::defined is false for everything else.
+ *
+ *   hid_t type = H5Type<float>::get(); // H5T_NATIVE_FLOAT
+ */
+template<typename T>
+struct H5Type
+{
+  static constexpr bool defined = false;
+};
+
+#define H5IO_NATIVE_TYPE(CTYPE, H5TYPE) \
+  template<> \
+  struct H5Type<CTYPE> \
+  { \
+    static constexpr bool defined = true; \
+    static hid_t get() { return H5TYPE; } \
+  };
+
+H5IO_NATIVE_TYPE(char, H5T_NATIVE_CHAR)
+H5IO_NATIVE_TYPE(signed char, H5T_NATIVE_SCHAR)
+H5IO_NATIVE_TYPE(unsigned char, H5T_NATIVE_UCHAR)
+H5IO_NATIVE_TYPE(short, H5T_NATIVE_SHORT)
+H5IO_NATIVE_TYPE(unsigned short, H5T_NATIVE_USHORT)
+H5IO_NATIVE_TYPE(int, H5T_NATIVE_INT)
+H5IO_NATIVE_TYPE(unsigned int, H5T_NATIVE_UINT)
+H5IO_NATIVE_TYPE(long, H5T_NATIVE_LONG)
+H5IO_NATIVE_TYPE(unsigned long, H5T_NATIVE_ULONG)
+H5IO_NATIVE_TYPE(long long, H5T_NATIVE_LLONG)
+H5IO_NATIVE_TYPE(unsigned long long, H5T_NATIVE_ULLONG)
+H5IO_NATIVE_TYPE(float, H5T_NATIVE_FLOAT)
+H5IO_NATIVE_TYPE(double, H5T_NATIVE_DOUBLE)
+H5IO_NATIVE_TYPE(long double, H5T_NATIVE_LDOUBLE)
+
+#undef H5IO_NATIVE_TYPE
+
+#endif
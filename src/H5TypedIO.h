@@ -0,0 +1,140 @@
+#ifndef H5TypedIO_h
+#define H5TypedIO_h
+
+#include <hdf5.h>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include "H5SizeArray.h"
+#include "H5Type.h"
+#include "H5IO.h"
+
+/**
+ * @brief H5IO for arrays of T
+ * @details The memory and dataset types are H5Type<T>, and type checking
+ * is on: datasets stored in another type are not read, so HDF5 never
+ * converts unless asked to with setFileType or allowConversion.
+ *
+ * Arrays can be given as pointers, std::vectors, or anything else with
+ * data() and size() (std::array, std::span...). Their dimensions are the
+ * ones given to the constructor.
+ *
+ *   H5TypedIO<float> io (H5SizeArray {64, 64});
+ *   std::vector<float> grid (64 * 64);
+ *   io.write(grid, "grid.h5", "grid");
+ *   io.read(grid, "grid.h5", "grid");
+ */
+template<typename T>
+class H5TypedIO : public H5IO
+{
+  static_assert(H5Type<T>::defined, "T has no native HDF5 type; use H5IO instead");
+
+private:
+  hsize_t num_elements; //elements in the whole array
+
+  void _initialize(const H5SizeArray &dims_in)
+  {
+    num_elements = 1;
+    for(int i = 0; i < dims_in.getRank(); ++i)
+      num_elements *= dims_in[i];
+    setTypeCheck(true);
+  }
+
+  template<typename Container>
+  static void _checkElementType()
+  {
+    typedef typename std::remove_cv<typename std::remove_pointer<
+      decltype(std::declval<Container &>().data())>::type>::type element_type;
+    static_assert(std::is_same<element_type, T>::value, "array elements must be T");
+  }
+
+public:
+  explicit H5TypedIO(H5SizeArray dims_in)
+  : H5IO(dims_in.getRank(), dims_in, H5Type<T>::get())
+  {
+    _initialize(dims_in);
+  }
+
+  explicit H5TypedIO(hsize_t num_elements_in)
+  : H5IO(1, num_elements_in, H5Type<T>::get())
+  {
+    _initialize(H5SizeArray(1, num_elements_in));
+  }
+
+  /**
+   * @brief Store new datasets as F, converting from T when writing
+   * @details Turns type checking off, so reads convert as well.
+   */
+  template<typename F>
+  void setFileType()
+  {
+    static_assert(H5Type<F>::defined, "F has no native HDF5 type");
+    setDatasetType(H5Type<F>::get());
+    setTypeCheck(false);
+  }
+
+  /**
+   * @brief Let HDF5 convert between T and dataset types
+   */
+  void allowConversion()
+  {
+    setTypeCheck(false);
+  }
+
+  hsize_t getNumElements() const
+  {
+    return num_elements;
+  }
+
+  bool write(const T *array, std::string file_name, std::string dset_name, bool append_flag = false)
+  {
+    return writeArrayToFile(const_cast<T *>(array), file_name, dset_name, append_flag);
+  }
+
+  /**
+   * @brief Write a container holding at least getNumElements() elements
+   */
+  template<typename Container>
+  auto write(const Container &array, std::string file_name, std::string dset_name, bool append_flag = false)
+    -> decltype(array.data(), array.size(), bool())
+  {
+    _checkElementType<const Container>();
+    if(array.size() < num_elements)
+      return false;
+    return write(array.data(), file_name, dset_name, append_flag);
+  }
+
+  bool read(T *array, std::string file_name, std::string dset_name)
+  {
+    return readArrayFromFile(array, file_name, dset_name);
+  }
+
+  /**
+   * @brief Read into a vector, resizing it to getNumElements()
+   */
+  bool read(std::vector<T> &array, std::string file_name, std::string dset_name)
+  {
+    array.resize(num_elements);
+    return read(array.data(), file_name, dset_name);
+  }
+
+  /**
+   * @brief Read into a container holding at least getNumElements() elements
+   */
+  template<typename Container>
+  auto read(Container &array, std::string file_name, std::string dset_name)
+    -> decltype(array.data(), array.size(), bool())
+  {
+    _checkElementType<Container>();
+    if(array.size() < num_elements)
+      return false;
+    return read(array.data(), file_name, dset_name);
+  }
+
+  bool readRows(T *array, std::string file_name, std::string dset_name, hsize_t first_row, hsize_t num_rows)
+  {
+    return readRowsFromFile(array, file_name, dset_name, first_row, num_rows);
+  }
+};
+
+#endif
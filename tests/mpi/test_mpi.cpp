@@ -0,0 +1,76 @@
+#include <mpi.h>
+#include <iostream>
+#include <cstdio>
+
+#include "H5IO.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+  MPI_Init(&argc, &argv);
+
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  // each rank owns a 10x10 block of a (10*size)x10 array
+  H5SizeArray dims (2, 10, 10);
+  H5SizeArray global_dims (2, 10*size, 10);
+  H5SizeArray offset (2, 10*rank, 0);
+  int gridsize = 100;
+
+  float *f = new float[gridsize];
+  float *g = new float[gridsize];
+  for(int i = 0; i<gridsize; ++i)
+    f[i] = rank*gridsize + i;
+
+  if(rank == 0)
+    std::remove("test_mpi.h5");
+  MPI_Barrier(MPI_COMM_WORLD);
+
+  bool success = true;
+  {
+    H5IO myIO(2, dims, H5T_NATIVE_FLOAT);
+    myIO.setMPI(MPI_COMM_WORLD, global_dims, offset);
+
+    // all ranks write their block of one shared dataset
+    success = myIO.writeArrayToFile(f, "test_mpi.h5", "dataset0", false);
+
+    // and read it back
+    myIO.closeFile();
+    // (every rank must take part, so read even if the write failed)
+    if(!myIO.readArrayFromFile(g, "test_mpi.h5", "dataset0"))
+      success = false;
+    for(int i = 0; i<gridsize; ++i)
+      if(g[i] != f[i])
+        success = false;
+    myIO.closeFile();
+
+    // overwrite with one element marked dirty; the whole block is rewritten
+    myIO.setOverwrite(true);
+    f[5] = -1;
+    f[95] = -2;
+    H5SizeArray dirty_start (2, 10*rank, 5), dirty_count (2, 1, 1);
+    myIO.markDirty(dirty_start, dirty_count);
+    if(!myIO.writeArrayToFile(f, "test_mpi.h5", "dataset0", false))
+      success = false;
+    myIO.closeFile();
+    if(!myIO.readArrayFromFile(g, "test_mpi.h5", "dataset0"))
+      success = false;
+    for(int i = 0; i<gridsize; ++i)
+      if(g[i] != f[i])
+        success = false;
+    myIO.closeFile();
+  } // H5IO must be destroyed before MPI_Finalize
+
+  int local_ok = success, all_ok;
+  MPI_Allreduce(&local_ok, &all_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  if(rank == 0)
+    cout << (all_ok ? "MPI test passed" : "MPI test failed") << endl;
+
+  delete[] f;
+  delete[] g;
+  MPI_Finalize();
+  return all_ok ? 0 : 1;
+}
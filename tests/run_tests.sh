@@ -28,6 +28,29 @@ if [ $? -ne 0 ]; then
     exit 1
 fi
 
+# many H5IO objects on many threads
+./tests/test_threads
+if [ $? -ne 0 ]; then
+    echo "Error: threads run failed!"
+    exit 1
+fi
+
+# the same with H5LibraryLock locking, as without a thread safe HDF5
+./tests/test_threads_locked
+if [ $? -ne 0 ]; then
+    echo "Error: locked threads run failed!"
+    exit 1
+fi
+
+# MPI test, if built (cmake -DHDFIO_MPI=TRUE)
+if [ -x ./tests/test_mpi ]; then
+    mpirun -np 4 ./tests/test_mpi
+    if [ $? -ne 0 ]; then
+        echo "Error: MPI run failed!"
+        exit 1
+    fi
+fi
+
 echo ""
 echo ""
 echo "generated content in test.h5"
@@ -1,8 +1,13 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <cstdio>
+#include <vector>
+#include <future>
+#include <limits>
 
 #include "H5IO.h"
+#include "H5TypedIO.h"
 
 using namespace std;
 
@@ -19,19 +24,35 @@ int main()
   for(int i = 0; i<ARRAY_RANK; ++i)
     gridsize *= dims[i];
 
+  // sizes are 64 bit; arrays copy like values
+  H5SizeArray big (2, 1ULL << 33, 3), listed = {1ULL << 33, 3};
+  H5SizeArrayN<2> fixed (1ULL << 33, 3);
+  H5SizeArray copied (big);
+  copied[1] = 4;
+  if(big[0] != (1ULL << 33) || listed[0] != big[0] || fixed[0] != big[0]
+      || fixed.getRank() != 2 || big[1] != 3)
+    return 1;
+
   float *f = new float[gridsize];
+  float *g = new float[gridsize];
   
   for(int i = 0; i<gridsize; ++i)
   {
     f[i] = i;
   }
 
+  // start from a fresh file
+  std::remove("test.h5");
+
   // Create H5IO class for I/O
   H5IO myIO(ARRAY_RANK, dims, H5T_NATIVE_FLOAT);
 
   // include debugging output
   myIO.setVerbosity(H5IO::debug);
 
+  // count and time I/O phases
+  myIO.setStats(true);
+
   // Write an ARRAY_RANK array to a file
   myIO.setMemHyperslab(start, stride);
   myIO.writeArrayToFile(f, "test.h5", "dataset0", false);
@@ -42,5 +63,337 @@ int main()
   // append again:
   myIO.writeArrayToFile(f, "test.h5", "/group/dataset1", true);
 
+  // close the file (it is kept open between calls) and read back
+  myIO.closeFile();
+  myIO.setMemHyperslab(start, stride);
+  if(!myIO.readArrayFromFile(g, "test.h5", "dataset0"))
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(g[i] != f[i])
+      return 1;
+
+  // chunk into 2x10 float slabs (80 bytes) instead of one 10x10 chunk
+  H5SizeArray access (2, 2, 0);
+  myIO.setChunkAuto(80, access);
+  myIO.setMemHyperslab(start, stride);
+  myIO.writeArrayToFile(f, "test.h5", "dataset3", false);
+  myIO.setChunkWhole();
+  if(!myIO.readArrayFromFile(g, "test.h5", "dataset3"))
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(g[i] != f[i])
+      return 1;
+
+  // per-dataset compression; lz4 falls back to deflate if not installed
+  myIO.setDatasetCompression("dataset4", H5Compression(H5Compression::shuffle_deflate, 1));
+  myIO.setDatasetCompression("dataset5", H5Compression(H5Compression::lz4, 0));
+  myIO.writeArrayToFile(f, "test.h5", "dataset4", false);
+  myIO.writeArrayToFile(f, "test.h5", "dataset5", false);
+  if(!myIO.readArrayFromFile(g, "test.h5", "dataset4"))
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(g[i] != f[i])
+      return 1;
+
+  // compress chunks on 4 threads; read back through HDF5's own pipeline
+  myIO.setThreads(4);
+  myIO.setParallelCompression(true);
+  myIO.setChunkAuto(80, access);
+  myIO.setCompression(H5Compression::shuffle_deflate, 6);
+  myIO.writeArrayToFile(f, "test.h5", "dataset6", false);
+  myIO.setParallelCompression(false);
+  if(!myIO.readArrayFromFile(g, "test.h5", "dataset6"))
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(g[i] != f[i])
+      return 1;
+  // and decompress chunks on 4 threads
+  myIO.setParallelCompression(true);
+  if(!myIO.readArrayFromFile(g, "test.h5", "dataset6"))
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(g[i] != f[i])
+      return 1;
+  myIO.setParallelCompression(false);
+  myIO.setCompression(H5Compression());
+  myIO.setChunkWhole();
+
+  // write in the background; f is copied so it may change immediately
+  std::future<bool> written = myIO.writeArrayToFileAsync(f, "test.h5", "dataset7", false);
+  std::vector<float> owned(f, f + gridsize);
+  myIO.setMemHyperslab1D(0, start, 2);
+  myIO.writeArrayToFileAsync(std::move(owned), "test.h5", "/group/dataset8", true);
+  if(!written.get())
+    return 1;
+  myIO.setMemHyperslab(start, stride);
+  if(!myIO.readArrayFromFile(g, "test.h5", "dataset7"))
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(g[i] != f[i])
+      return 1;
+
+  // buffered append: rows are written 4 at a time
+  H5IO rowIO(1, 5, H5T_NATIVE_FLOAT);
+  rowIO.setAppendBufferRows(4);
+  for(int i = 0; i<10; ++i)
+    rowIO.writeArrayToFile(f + 5*i, "test.h5", "/group/dataset2", true);
+  rowIO.closeFile();
+
+  H5SizeArray table_dims (2, 10, 5);
+  H5IO tableIO(2, table_dims, H5T_NATIVE_FLOAT);
+  if(!tableIO.readArrayFromFile(g, "test.h5", "/group/dataset2"))
+    return 1;
+  for(int i = 0; i<50; ++i)
+    if(g[i] != f[i])
+      return 1;
+
+  // read rows 2-4 of the appended table
+  H5SizeArray rows_dims (2, 3, 5);
+  H5IO rowsIO(2, rows_dims, H5T_NATIVE_FLOAT);
+  if(!rowsIO.readRowsFromFile(g, "test.h5", "/group/dataset2", 2, 3))
+    return 1;
+  for(int i = 0; i<15; ++i)
+    if(g[i] != f[10 + i])
+      return 1;
+
+  // read a 3x4 box of dataset0 starting at (1, 2)
+  H5SizeArray box_dims (2, 3, 4), box_start (2, 1, 2);
+  H5IO boxIO(2, box_dims, H5T_NATIVE_FLOAT);
+  boxIO.setFileHyperslab(box_start, box_dims);
+  if(!boxIO.readArrayFromFile(g, "test.h5", "dataset0"))
+    return 1;
+  for(int i = 0; i<12; ++i)
+    if(g[i] != f[(1 + i/4)*10 + 2 + i%4])
+      return 1;
+
+  // map a contiguous dataset; chunked ones are read instead
+  myIO.setContiguous();
+  myIO.writeArrayToFile(f, "test.h5", "dataset9", false);
+  myIO.setChunkWhole();
+  H5MappedArray view;
+  if(!myIO.mapArrayFromFile(view, "test.h5", "dataset9") || !view.isMapped()
+      || view.getNumElements() != (hsize_t) gridsize)
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(((const float *) view.getData())[i] != f[i])
+      return 1;
+  if(!myIO.mapArrayFromFile(view, "test.h5", "dataset0") || view.isMapped())
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(((const float *) view.getData())[i] != f[i])
+      return 1;
+
+  // write every other element in both dimensions, then read it back
+  H5SizeArray stride2 (2, 2, 2);
+  myIO.setMemHyperslab(start, stride2);
+  myIO.writeArrayToFile(f, "test.h5", "dataset10", false);
+  for(int i = 0; i<gridsize; ++i)
+    g[i] = -1;
+  if(!myIO.readArrayFromFile(g, "test.h5", "dataset10"))
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(g[i] != ((i/10) % 2 == 0 && i % 2 == 0 ? f[i] : -1))
+      return 1;
+  myIO.setMemHyperslab(start, stride);
+
+  // overwrite a checkpoint, writing only what changed
+  H5IO ckptIO(ARRAY_RANK, dims, H5T_NATIVE_FLOAT);
+  H5SizeArray ckpt_chunk (2, 5, 5);
+  ckptIO.setChunkDims(ckpt_chunk);
+  ckptIO.writeArrayToFile(f, "test.h5", "checkpoint", false);
+  if(ckptIO.writeArrayToFile(f, "test.h5", "checkpoint", false))
+    return 1;
+  ckptIO.setIncremental(true);
+  ckptIO.setStats(true);
+  std::vector<float> h(f, f + gridsize);
+  h[0] = -5;
+  ckptIO.writeArrayToFile(&h[0], "test.h5", "checkpoint", false); // all chunks, no hashes yet
+  h[1] = -6;
+  ckptIO.resetStats();
+  ckptIO.writeArrayToFile(&h[0], "test.h5", "checkpoint", false); // one 5x5 chunk
+  H5IOStats ckpt_stats;
+  ckptIO.getStats(ckpt_stats);
+  if(ckpt_stats.getBytesWritten() != 25*sizeof(float))
+    return 1;
+  h[99] = -7;
+  H5SizeArray dirty_start (2, 9, 9), dirty_count (2, 1, 1);
+  ckptIO.markDirty(dirty_start, dirty_count);
+  ckptIO.writeArrayToFile(&h[0], "test.h5", "checkpoint", false); // one element
+  if(!ckptIO.readArrayFromFile(g, "test.h5", "checkpoint"))
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(g[i] != h[i])
+      return 1;
+
+  // typed front-end: no conversion unless asked for
+  H5TypedIO<float> typedIO (dims);
+  std::vector<float> typed_in (f, f + gridsize), typed_out;
+  std::vector<double> typed_double (gridsize);
+  if(!typedIO.write(typed_in, "test.h5", "typed") || !typedIO.read(typed_out, "test.h5", "typed")
+      || typed_out != typed_in)
+    return 1;
+  // nested groups are created once; objects in the path are refused
+  if(!typedIO.write(typed_in, "test.h5", "/deep/a/b/c/typed") || !typedIO.write(typed_in, "test.h5", "/deep/a/b/c/typed2")
+      || !typedIO.write(typed_in, "test.h5", "deep/a/typed") || typedIO.write(typed_in, "test.h5", "/typed/nested"))
+    return 1;
+  H5TypedIO<double> doubleIO (dims);
+  if(doubleIO.read(typed_double, "test.h5", "typed")) // stored as float
+    return 1;
+  doubleIO.allowConversion();
+  if(!doubleIO.read(typed_double, "test.h5", "typed") || typed_double[5] != 5.0)
+    return 1;
+
+  // store doubles as floats and floats as halves
+  std::vector<double> doubles (f, f + gridsize), doubles_out (gridsize);
+  H5IO doubleToFloat (ARRAY_RANK, dims, H5T_NATIVE_DOUBLE);
+  doubleToFloat.setThreads(2);
+  doubleToFloat.setStats(true);
+  doubleToFloat.setDatasetType(H5T_NATIVE_FLOAT);
+  if(!doubleToFloat.writeArrayToFile(&doubles[0], "test.h5", "converted", false)
+      || !typedIO.read(typed_out, "test.h5", "converted") || typed_out != typed_in
+      || !doubleToFloat.readArrayFromFile(&doubles_out[0], "test.h5", "converted") || doubles_out != doubles)
+    return 1;
+  H5IOStats convert_stats;
+  doubleToFloat.getStats(convert_stats);
+  if(convert_stats.getCalls(H5IOStats::conversion) != 2)
+    return 1;
+  hid_t half_type = H5Convert::createHalfType();
+  H5IO floatToHalf (ARRAY_RANK, dims, H5T_NATIVE_FLOAT);
+  floatToHalf.setDatasetType(half_type);
+  if(!floatToHalf.writeArrayToFile(f, "test.h5", "half", false)
+      || !floatToHalf.readArrayFromFile(g, "test.h5", "half"))
+    return 1;
+  H5Tclose(half_type);
+  for(int i = 0; i<gridsize; ++i)
+    if(g[i] != f[i])
+      return 1;
+
+  // several fields in one batch; existing datasets are not overwritten
+  H5IO batchIO (ARRAY_RANK, dims, H5T_NATIVE_FLOAT);
+  std::vector<H5IOBatchItem> batch;
+  batch.push_back(H5IOBatchItem(f, "/fields/f"));
+  batch.push_back(H5IOBatchItem(&doubles[0], "/fields/d", H5T_NATIVE_DOUBLE));
+  batch.push_back(H5IOBatchItem(f, "dataset0"));
+  if(batchIO.writeArraysToFile(batch, "test.h5") || batchIO.getBatchReport().datasets != 2
+      || !doubleToFloat.readArrayFromFile(&doubles_out[0], "test.h5", "/fields/d") || doubles_out != doubles
+      || !batchIO.readArrayFromFile(g, "test.h5", "/fields/f") || g[7] != f[7])
+    return 1;
+
+  // read a restart in one go, decompressing while reading
+  batchIO.setThreads(4);
+  batchIO.setParallelCompression(true);
+  std::vector<float> restart(3 * gridsize, -1);
+  std::vector<H5IOReadItem> restart_items;
+  restart_items.push_back(H5IOReadItem(&restart[0], "dataset6"));
+  restart_items.push_back(H5IOReadItem(&restart[gridsize], "checkpoint"));
+  restart_items.push_back(H5IOReadItem(&restart[2 * gridsize], "/fields/f", start, dims));
+  if(!batchIO.readArraysFromFile(restart_items, "test.h5") || batchIO.getBatchReport().datasets != 3
+      || restart_items[0].bytes != gridsize * sizeof(float))
+    return 1;
+  for(int i = 0; i<gridsize; ++i)
+    if(restart[i] != f[i] || restart[2 * gridsize + i] != f[i])
+      return 1;
+
+  // 2x and 4x coarser means for quick looks
+  H5IO pyramidIO (ARRAY_RANK, dims, H5T_NATIVE_FLOAT);
+  pyramidIO.setPyramid(2, H5Pyramid::mean);
+  H5SizeArray coarse_dims (2, 5, 5), coarser_dims (2, 3, 3);
+  H5IO coarseIO (ARRAY_RANK, coarse_dims, H5T_NATIVE_FLOAT), coarserIO (ARRAY_RANK, coarser_dims, H5T_NATIVE_FLOAT);
+  if(!pyramidIO.writeArrayToFile(f, "test.h5", "pyramid", false)
+      || !coarseIO.readArrayFromFile(g, "test.h5", H5Pyramid::getLevelName("pyramid", 1))
+      || g[0] != 5.5 || g[7] != 29.5
+      || !coarserIO.readArrayFromFile(g, "test.h5", H5Pyramid::getLevelName("pyramid", 2))
+      || g[0] != 16.5 || g[8] != 93.5)
+    return 1;
+
+  // per-chunk statistics, then read only the chunks holding values >= 60
+  H5IO indexedIO (ARRAY_RANK, dims, H5T_NATIVE_FLOAT);
+  indexedIO.setChunkDims(ckpt_chunk);
+  indexedIO.setCompression(H5Compression::deflate, 1);
+  indexedIO.setThreads(2);
+  indexedIO.setParallelCompression(true);
+  indexedIO.setChunkStats(true, 4, 0, 100);
+  std::vector<H5SizeArray> chunk_starts, chunk_counts;
+  for(int i = 0; i<gridsize; ++i)
+    g[i] = -1;
+  if(!indexedIO.writeArrayToFile(f, "test.h5", "indexed", false)
+      || !batchIO.readArrayWhere(g, "test.h5", "indexed", 60, 1e30, chunk_starts, chunk_counts)
+      || chunk_starts.size() != 2 || chunk_starts[0][0] != 5 || chunk_counts[1][1] != 5
+      || g[0] != -1 || g[55] != 55 || g[99] != 99)
+    return 1;
+
+  // NaNs are left out of chunk minima, maxima and histograms
+  H5SizeArray nan_dims (1, 64), nan_chunk (1, 16);
+  H5IO nanIO (1, nan_dims, H5T_NATIVE_FLOAT);
+  nanIO.setChunkDims(nan_chunk);
+  nanIO.setChunkStats(true, 4, 0, 100);
+  std::vector<float> nans(64, 50), nans_out(64, -1);
+  for(int i = 0; i<64; i += 3)
+    nans[i] = std::numeric_limits<float>::quiet_NaN();
+  if(!nanIO.writeArrayToFile(&nans[0], "test.h5", "nans", false)
+      || !nanIO.readArrayWhere(&nans_out[0], "test.h5", "nans", 40, 60, chunk_starts, chunk_counts)
+      || chunk_starts.size() != 4 || nans_out[1] != 50 || nans_out[17] != 50)
+    return 1;
+
+  // big chunk caches, alignment and the latest format
+  H5IO tunedIO (ARRAY_RANK, dims, H5T_NATIVE_FLOAT);
+  tunedIO.setAccess(H5Access(H5Access::throughput));
+  tunedIO.setChunkDims(ckpt_chunk);
+  if(!tunedIO.writeArrayToFile(f, "tuned.h5", "tuned", false) || !tunedIO.readArrayFromFile(g, "tuned.h5", "tuned")
+      || g[42] != f[42])
+    return 1;
+  tunedIO.closeFile();
+  std::remove("tuned.h5");
+
+  // build a file in memory, then reopen its bytes
+  H5Access in_memory;
+  in_memory.setInMemory(true, false, 1 << 16);
+  tunedIO.setAccess(in_memory);
+  std::vector<char> image;
+  if(!tunedIO.writeArrayToFile(f, "memory.h5", "a", false) || !tunedIO.writeArrayToFileAsync(g, "memory.h5", "b", false).get()
+      || !tunedIO.getFileImage(image) || image.empty())
+    return 1;
+  tunedIO.closeFile();
+  FILE *memory_file = std::fopen("memory.h5", "r");
+  if(memory_file)
+    return 1;
+  if(!tunedIO.openFileImage(&image[0], image.size(), "memory.h5") || !tunedIO.readArrayFromFile(g, "memory.h5", "a")
+      || g[42] != f[42] || !tunedIO.writeArrayToFile(f, "memory.h5", "c", false))
+    return 1;
+  tunedIO.closeFile();
+
+  // columns written to 3 subfiles, read back as one array
+  H5IO splitIO (ARRAY_RANK, dims, H5T_NATIVE_FLOAT);
+  splitIO.setSubfiles(3, 1);
+  splitIO.setCompression(H5Compression::deflate, 1);
+  if(!splitIO.writeArrayToFile(f, "split.h5", "fields/split", false)
+      || !batchIO.readArrayFromFile(g, "split.h5", "fields/split") || g[0] != f[0] || g[37] != f[37] || g[99] != f[99]
+      || splitIO.writeArrayToFile(&h[0], "split.h5", "fields/split", false))
+    return 1;
+  // batches are split too
+  H5SizeArray part_dims (2, 10, 3);
+  H5IO partIO (ARRAY_RANK, part_dims, H5T_NATIVE_FLOAT);
+  if(!splitIO.writeArraysToFile(std::vector<H5IOBatchItem>(1, H5IOBatchItem(f, "batched")), "split.h5")
+      || !partIO.readArrayFromFile(g, H5IO::getSubfileName("split.h5", 0), "batched") || g[4] != f[11])
+    return 1;
+  partIO.closeFile();
+  splitIO.setOverwrite(true);
+  if(!splitIO.writeArrayToFile(&h[0], "split.h5", "fields/split", false)
+      || !batchIO.readArrayFromFile(g, "split.h5", "fields/split") || g[0] != h[0] || g[99] != h[99])
+    return 1;
+  splitIO.closeFile();
+  batchIO.closeFile();
+  for(int i = 0; i<3; ++i)
+    std::remove(H5IO::getSubfileName("split.h5", i).c_str());
+  std::remove("split.h5");
+
+  H5IOStats io_stats;
+  myIO.getStats(io_stats);
+  cout << myIO.getStatsJSON() << endl;
+  if(io_stats.getCalls(H5IOStats::write) == 0 || io_stats.getBytesRead() == 0)
+    return 1;
+
+  delete[] f;
+  delete[] g;
   return 0;
 }
@@ -0,0 +1,182 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <future>
+
+#include "H5IO.h"
+
+using namespace std;
+
+/**
+ * Stress test of separate H5IO objects used from many threads at once.
+ *
+ * Each thread writes its own file with its own H5IO: whole arrays in nested
+ * groups, compressed on the H5IO's own pool, batches, appends, asynchronous
+ * writes, existence checks of missing datasets and overwrites, and a second
+ * file split into subfiles, written whole, in a batch and asynchronously.
+ * Then it reads everything back. Returns nonzero if any call failed or any
+ * value read differs from what was written.
+ *
+ * The test_threads_locked build defines H5IO_FORCE_LIBRARY_LOCK, so that
+ * the same run goes through H5LibraryLock with a thread safe HDF5 as well.
+ */
+
+#define WRITERS 8
+#define ROUNDS 4
+#define SUBFILES 3
+
+static string _name(const char *prefix, int n)
+{
+  ostringstream name;
+  name << prefix << n;
+  return name.str();
+}
+
+static float _value(int writer, int dset, int i)
+{
+  return (float) (writer * 100000 + dset * 1000 + i % 997);
+}
+
+/**
+ * @brief Read a dataset and compare it with array; returns the number of failures
+ */
+static int _check(H5IO &reader, const string &file_name, const string &dset_name, const vector<float> &array)
+{
+  vector<float> read(array.size());
+  if(!reader.readArrayFromFile(&read[0], file_name, dset_name))
+    return 1;
+  for(size_t i = 0; i < read.size(); ++i)
+    if(read[i] != array[i])
+      return 1;
+  return 0;
+}
+
+/**
+ * @brief Write and check one file; returns the number of failures
+ */
+static int _writeAndRead(int writer)
+{
+  int failures = 0;
+  string file_name = _name("test_threads_", writer) + ".h5";
+  string split_name = _name("test_threads_split_", writer) + ".h5";
+  std::remove(file_name.c_str());
+  for(int s = 0; s < SUBFILES; ++s)
+    std::remove(H5IO::getSubfileName(split_name, s).c_str());
+  std::remove(split_name.c_str());
+
+  H5SizeArray dims (2, 64, 48);
+  const int n = 64 * 48;
+  vector< vector<float> > arrays(ROUNDS, vector<float>(n));
+  for(int d = 0; d < ROUNDS; ++d)
+    for(int i = 0; i < n; ++i)
+      arrays[d][i] = _value(writer, d, i);
+
+  {
+    H5IO io(2, dims, H5T_NATIVE_FLOAT);
+    io.setCompression(H5Compression::shuffle_deflate, 1);
+    io.setThreads(2);
+    io.setParallelCompression(true);
+    io.setOverwrite(true);
+
+    for(int d = 0; d < ROUNDS; ++d)
+    {
+      string dset_name = _name("group", d % 2) + "/" + _name("sub", d) + "/data";
+      if(!io.writeArrayToFile(&arrays[d][0], file_name, dset_name, false))
+        ++failures;
+      // write it again, over what is there
+      if(!io.writeArrayToFile(&arrays[d][0], file_name, dset_name, false))
+        ++failures;
+    }
+
+    vector<H5IOBatchItem> batch;
+    for(int d = 0; d < ROUNDS; ++d)
+      batch.push_back(H5IOBatchItem(&arrays[d][0], _name("batch", d)));
+    if(!io.writeArraysToFile(batch, file_name))
+      ++failures;
+
+    // missing datasets and paths through datasets fail quietly
+    vector<float> unused(n);
+    if(io.readArrayFromFile(&unused[0], file_name, "group0/missing/data"))
+      ++failures;
+    if(io.readArrayFromFile(&unused[0], file_name, "group0/sub0/data/below"))
+      ++failures;
+
+    vector< future<bool> > pending;
+    for(int d = 0; d < ROUNDS; ++d)
+      pending.push_back(io.writeArrayToFileAsync(&arrays[d][0], file_name, _name("async", d), false));
+    for(size_t p = 0; p < pending.size(); ++p)
+      if(!pending[p].get())
+        ++failures;
+    io.closeFile();
+  }
+
+  {
+    H5SizeArray row (1, 48);
+    H5IO rows(1, row, H5T_NATIVE_FLOAT);
+    for(int r = 0; r < 64; ++r)
+      if(!rows.writeArrayToFile(&arrays[0][r * 48], file_name, "table", true))
+        ++failures;
+    rows.closeFile();
+  }
+
+  {
+    H5IO split(2, dims, H5T_NATIVE_FLOAT);
+    split.setSubfiles(SUBFILES, 1);
+    split.setCompression(H5Compression::deflate, 1);
+    if(!split.writeArrayToFile(&arrays[0][0], split_name, "whole", false))
+      ++failures;
+    vector<H5IOBatchItem> batch;
+    batch.push_back(H5IOBatchItem(&arrays[1][0], "batch1"));
+    batch.push_back(H5IOBatchItem(&arrays[2][0], "batch2"));
+    if(!split.writeArraysToFile(batch, split_name))
+      ++failures;
+    if(!split.writeArrayToFileAsync(&arrays[3][0], split_name, "async", false).get())
+      ++failures;
+    split.closeFile();
+  }
+
+  H5IO reader(2, dims, H5T_NATIVE_FLOAT);
+  for(int d = 0; d < ROUNDS; ++d)
+  {
+    failures += _check(reader, file_name, _name("group", d % 2) + "/" + _name("sub", d) + "/data", arrays[d]);
+    failures += _check(reader, file_name, _name("batch", d), arrays[d]);
+    failures += _check(reader, file_name, _name("async", d), arrays[d]);
+  }
+  failures += _check(reader, file_name, "table", arrays[0]);
+  failures += _check(reader, split_name, "whole", arrays[0]);
+  failures += _check(reader, split_name, "batch1", arrays[1]);
+  failures += _check(reader, split_name, "batch2", arrays[2]);
+  failures += _check(reader, split_name, "async", arrays[3]);
+  reader.closeFile();
+
+  std::remove(file_name.c_str());
+  for(int s = 0; s < SUBFILES; ++s)
+    std::remove(H5IO::getSubfileName(split_name, s).c_str());
+  std::remove(split_name.c_str());
+  return failures;
+}
+
+int main()
+{
+  cout << "HDF5 thread safe: " << (H5LibraryLock::isLibraryThreadSafe() ? "yes" : "no") << endl;
+  cout << "H5LibraryLock locking: " << (H5LibraryLock::isLocking() ? "yes" : "no") << endl;
+
+  vector< future<int> > writers;
+  for(int w = 0; w < WRITERS; ++w)
+    writers.push_back(async(launch::async, _writeAndRead, w));
+
+  int failures = 0;
+  for(int w = 0; w < WRITERS; ++w)
+  {
+    int writer_failures = writers[w].get();
+    if(writer_failures)
+      cout << "writer " << w << ": " << writer_failures << " failures" << endl;
+    failures += writer_failures;
+  }
+
+  cout << (failures ? "FAILED" : "passed") << endl;
+  return failures ? 1 : 0;
+}